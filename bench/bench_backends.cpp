@@ -0,0 +1,157 @@
+// Head-to-head of the two bookID indexes: the red-black tree (RBTree with
+// subtree sizes, as RBTreeIndex uses it) and the B+-tree (as BTreeIndex uses
+// it), for random-order inserts, point lookups (half of them miss), short
+// range scans and then erasing three keys in four in random order. The last
+// column is the nodes left after the erases: one per key for the red-black
+// tree, and for the B+-tree as many as its merges leave. Values are
+// pointer-sized stand-ins for Book*, so no books are allocated and larger
+// sizes fit in memory. 100M keys need about 6.4 GB for the red-black tree
+// alone.
+//
+// Usage: bench_backends [keys ...]
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+#include "bplus_tree.h"
+#include "rb_tree.h"
+
+namespace
+{
+    using RedBlack = RBTree<int, long, std::less<int>, SlabPool, SubtreeSize>;
+
+    const long kLookups = 5000000;
+    const long kScans = 500000;
+    const int kScanLength = 50;
+
+    std::size_t erasedCount(const std::vector<int> &order) { return order.size() / 4 * 3; }
+
+    struct Result
+    {
+        double insertNs;
+        double findNs;
+        double scanNs;
+        double eraseNs;
+        unsigned long long nodesLeft;
+        long long checksum; // Summed over lookups and scans; both trees must agree.
+    };
+
+    double seconds(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    Result runRedBlack(const std::vector<int> &order, const std::vector<int> &probes, const std::vector<int> &starts)
+    {
+        Result result{};
+        RedBlack tree;
+        auto start = std::chrono::steady_clock::now();
+        for (int key : order)
+            tree.insert(key, key);
+        result.insertNs = seconds(start) * 1e9 / order.size();
+
+        start = std::chrono::steady_clock::now();
+        for (int key : probes)
+            if (RedBlack::Node *node = tree.find(key))
+                result.checksum += node->value;
+        result.findNs = seconds(start) * 1e9 / probes.size();
+
+        start = std::chrono::steady_clock::now();
+        for (int key : starts)
+        {
+            RedBlack::Node *node = tree.lowerBound(key);
+            for (int i = 0; i < kScanLength && node != nullptr; ++i, node = RedBlack::next(node))
+                result.checksum += node->value;
+        }
+        result.scanNs = seconds(start) * 1e9 / starts.size();
+
+        start = std::chrono::steady_clock::now();
+        for (std::size_t i = 0; i < erasedCount(order); ++i)
+            tree.erase(tree.find(order[i]));
+        result.eraseNs = seconds(start) * 1e9 / erasedCount(order);
+        result.nodesLeft = order.size() - erasedCount(order);
+        return result;
+    }
+
+    Result runBPlus(const std::vector<int> &order, const std::vector<int> &probes, const std::vector<int> &starts)
+    {
+        Result result{};
+        BPlusTree<long> tree;
+        auto start = std::chrono::steady_clock::now();
+        for (int key : order)
+            tree.insert(key, key);
+        result.insertNs = seconds(start) * 1e9 / order.size();
+
+        start = std::chrono::steady_clock::now();
+        for (int key : probes)
+        {
+            BPlusTree<long>::Cursor found = tree.find(key);
+            if (found.valid())
+                result.checksum += found.value();
+        }
+        result.findNs = seconds(start) * 1e9 / probes.size();
+
+        start = std::chrono::steady_clock::now();
+        for (int key : starts)
+        {
+            BPlusTree<long>::Cursor it = tree.lowerBound(key);
+            for (int i = 0; i < kScanLength && it.valid(); ++i, it.next())
+                result.checksum += it.value();
+        }
+        result.scanNs = seconds(start) * 1e9 / starts.size();
+
+        start = std::chrono::steady_clock::now();
+        for (std::size_t i = 0; i < erasedCount(order); ++i)
+            tree.erase(tree.find(order[i]));
+        result.eraseNs = seconds(start) * 1e9 / erasedCount(order);
+        result.nodesLeft = tree.shape().nodes;
+        return result;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    std::vector<long> sizes;
+    for (int i = 1; i < argc; ++i)
+        sizes.push_back(std::atol(argv[i]));
+    if (sizes.empty())
+        sizes = {1000000, 10000000};
+
+    std::printf("%-12s %-8s %14s %14s %18s %14s %14s\n", "keys", "index", "insert ns/op", "find ns/op", "scan(50) ns/op", "erase ns/op",
+                "nodes left");
+    for (long keys : sizes)
+    {
+        if (keys < 1 || keys > 1000000000)
+        {
+            std::fprintf(stderr, "key count out of range: %ld\n", keys);
+            return 1;
+        }
+        std::mt19937 rng(42);
+        std::vector<int> order(keys);
+        for (long i = 0; i < keys; ++i)
+            order[i] = static_cast<int>(i * 2);
+        std::shuffle(order.begin(), order.end(), rng);
+        std::uniform_int_distribution<int> pick(0, static_cast<int>(keys * 2 - 1)); // Odd keys miss.
+        std::vector<int> probes(kLookups), starts(kScans);
+        for (int &key : probes)
+            key = pick(rng);
+        for (int &key : starts)
+            key = pick(rng);
+
+        // One tree at a time, so the larger sizes fit.
+        Result redBlack = runRedBlack(order, probes, starts);
+        Result bplus = runBPlus(order, probes, starts);
+        std::printf("%-12ld %-8s %14.1f %14.1f %18.1f %14.1f %14llu\n", keys, "RBTree", redBlack.insertNs, redBlack.findNs, redBlack.scanNs,
+                    redBlack.eraseNs, redBlack.nodesLeft);
+        std::printf("%-12ld %-8s %14.1f %14.1f %18.1f %14.1f %14llu\n", keys, "B+-tree", bplus.insertNs, bplus.findNs, bplus.scanNs,
+                    bplus.eraseNs, bplus.nodesLeft);
+        if (redBlack.checksum != bplus.checksum)
+        {
+            std::fprintf(stderr, "indexes disagree at %ld keys\n", keys);
+            return 1;
+        }
+    }
+    return 0;
+}
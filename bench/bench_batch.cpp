@@ -0,0 +1,96 @@
+// Applies batches of borrow/return/print events to GatorLibrary one call at a
+// time and through ApplyBatch, and reports the throughput of both. The two
+// libraries must end in the same state; the final catalogs are compared.
+//
+// Usage: bench_batch [books] [batch size] [batches]
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+#include "gator_library.h"
+#include "output_sink.h"
+
+namespace
+{
+    std::vector<BookOperation> makeBatch(std::mt19937 &rng, int books, int size)
+    {
+        std::uniform_int_distribution<int> book(0, books - 1), patron(0, 2), percent(0, 99);
+        std::vector<BookOperation> batch(size);
+        for (BookOperation &op : batch)
+        {
+            int roll = percent(rng);
+            op.kind = roll < 45 ? BookOperation::Borrow : roll < 90 ? BookOperation::Return : BookOperation::Print;
+            op.bookID = book(rng) * 2; // Even IDs; odd ones below are misses.
+            if (roll % 10 == 0)
+                ++op.bookID;
+            op.patronID = (op.bookID / 2 + patron(rng)) % 1000; // A few patrons per book, so returns often match.
+            op.priority = patron(rng);
+        }
+        return batch;
+    }
+
+    void load(GatorLibrary &library, int books)
+    {
+        std::vector<BookRecord> records;
+        records.reserve(books);
+        for (int id = 0; id < books; ++id)
+            records.push_back({id * 2, "Title", "Author", true});
+        library.BulkLoad(records.begin(), records.end());
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int books = argc > 1 ? std::atoi(argv[1]) : 1000000;
+    int batchSize = argc > 2 ? std::atoi(argv[2]) : 10000;
+    int batches = argc > 3 ? std::atoi(argv[3]) : 100;
+    if (books < 1 || batchSize < 1 || batches < 1)
+    {
+        std::fprintf(stderr, "need at least 1 book, 1 operation and 1 batch\n");
+        return 1;
+    }
+
+    std::mt19937 rng(42);
+    std::vector<std::vector<BookOperation>> work;
+    for (int b = 0; b < batches; ++b)
+        work.push_back(makeBatch(rng, books, batchSize));
+
+    GatorLibrary single, batched;
+    load(single, books);
+    load(batched, books);
+    OutputSink discard(-1, 1 << 16);
+
+    auto start = std::chrono::steady_clock::now();
+    for (const std::vector<BookOperation> &batch : work)
+        for (const BookOperation &op : batch)
+        {
+            if (op.kind == BookOperation::Borrow)
+                single.BorrowBook(op.patronID, op.bookID, op.priority, discard);
+            else if (op.kind == BookOperation::Return)
+                single.ReturnBook(op.patronID, op.bookID, discard);
+            else
+                single.PrintBook(op.bookID, discard);
+        }
+    double oneByOne = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    start = std::chrono::steady_clock::now();
+    for (const std::vector<BookOperation> &batch : work)
+        batched.ApplyBatch(batch, discard);
+    double together = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    long operations = static_cast<long>(batches) * batchSize;
+    std::printf("books=%d batch=%d batches=%d\n", books, batchSize, batches);
+    std::printf("  one at a time %12.0f ops/s\n", operations / oneByOne);
+    std::printf("  ApplyBatch    %12.0f ops/s  (%.2fx)\n", operations / together, oneByOne / together);
+
+    OutputSink a, b;
+    single.PrintBooks(0, books * 2, a);
+    batched.PrintBooks(0, books * 2, b);
+    if (a.contents() != b.contents())
+    {
+        std::fprintf(stderr, "final states differ\n");
+        return 1;
+    }
+    return 0;
+}
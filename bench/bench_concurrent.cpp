@@ -0,0 +1,72 @@
+// Read scaling of GatorLibrary in thread-safe mode. Each thread runs a mix of
+// PrintBook and FindClosestBook lookups into its own discarding OutputSink,
+// optionally with a share of BorrowBook/ReturnBook pairs on its own books.
+//
+// Usage: bench_concurrent [books] [ops per thread] [max threads] [write percent]
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "gator_library.h"
+#include "output_sink.h"
+
+int main(int argc, char *argv[])
+{
+    int books = argc > 1 ? std::atoi(argv[1]) : 1000000;
+    long opsPerThread = argc > 2 ? std::atol(argv[2]) : 1000000;
+    int maxThreads = argc > 3 ? std::atoi(argv[3]) : static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    int writePercent = argc > 4 ? std::atoi(argv[4]) : 0;
+
+    std::vector<BookRecord> records;
+    records.reserve(books);
+    for (int id = 0; id < books; ++id)
+        records.push_back({id * 2, "Title", "Author", true}); // Even IDs, so odd targets exercise FindClosestBook.
+    GatorLibrary library(true);
+    library.BulkLoad(records.begin(), records.end());
+
+    std::printf("books=%d ops/thread=%ld writes=%d%% hardware threads=%u\n", books, opsPerThread, writePercent, std::thread::hardware_concurrency());
+    double single = 0;
+    for (int threads = 1; threads <= maxThreads; threads *= 2)
+    {
+        std::atomic<bool> go(false);
+        std::vector<std::thread> workers;
+        for (int t = 0; t < threads; ++t)
+            workers.emplace_back([&, t]
+                                 {
+                std::mt19937 rng(t + 1);
+                std::uniform_int_distribution<int> pick(0, books - 1);
+                OutputSink discard(-1, 1 << 16);
+                while (!go.load(std::memory_order_acquire))
+                    std::this_thread::yield();
+                for (long i = 0; i < opsPerThread; ++i)
+                {
+                    int key = pick(rng);
+                    if (static_cast<int>(rng() % 100) < writePercent)
+                    {
+                        int bookID = (key - key % threads + t) * 2; // Each thread borrows from its own books.
+                        library.BorrowBook(t, bookID, 1, discard);
+                        library.ReturnBook(t, bookID, discard);
+                    }
+                    else if (i & 1)
+                        library.PrintBook(key * 2, discard);
+                    else
+                        library.FindClosestBook(key * 2 + 1, discard);
+                } });
+
+        auto start = std::chrono::steady_clock::now();
+        go.store(true, std::memory_order_release);
+        for (std::thread &worker : workers)
+            worker.join();
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        double throughput = threads * opsPerThread / elapsed;
+        if (threads == 1)
+            single = throughput;
+        std::printf("threads=%2d  %12.0f ops/s  speedup %.2fx\n", threads, throughput, throughput / single);
+    }
+    return 0;
+}
@@ -0,0 +1,122 @@
+// Compares lookups on the original node layout, where every comparison goes
+// through node->book->bookID, against the compact RBNode in gator_library.h.
+// Both layouts take their nodes and books from SlabPools, filled in the same
+// order, so the difference is the layout alone.
+//
+// Usage: bench_node_layout [books] [lookups]
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+#include "gator_library.h"
+
+namespace
+{
+    struct LegacyNode
+    { // The node layout GatorLibrary used before the key was inlined.
+        Book *book;
+        Color color;
+        LegacyNode *left;
+        LegacyNode *right;
+        LegacyNode *parent;
+
+        LegacyNode(Book *book) : book(book), color(RED), left(nullptr), right(nullptr), parent(nullptr) {}
+    };
+
+    template <typename Node>
+    Node *link(std::vector<Node *> &sorted, long lo, long hi)
+    { // Links sorted[lo..hi] into a balanced tree so both layouts share one shape.
+
+        if (lo > hi)
+            return nullptr;
+        long mid = lo + (hi - lo) / 2;
+        Node *node = sorted[mid];
+        node->left = link(sorted, lo, mid - 1);
+        node->right = link(sorted, mid + 1, hi);
+        return node;
+    }
+
+    template <typename Node, typename KeyOf>
+    double timeLookups(Node *root, const std::vector<int> &probes, KeyOf keyOf, long long &checksum)
+    {
+        auto start = std::chrono::steady_clock::now();
+        for (int key : probes)
+        {
+            Node *node = root;
+            while (node != nullptr)
+            {
+                int id = keyOf(node);
+                if (key < id)
+                    node = node->left;
+                else if (key > id)
+                    node = node->right;
+                else
+                {
+                    checksum += id;
+                    break;
+                }
+            }
+        }
+        std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+        return elapsed.count() / probes.size();
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    long books = argc > 1 ? std::atol(argv[1]) : 1000000;
+    long lookups = argc > 2 ? std::atol(argv[2]) : 5000000;
+
+    std::mt19937 rng(42);
+    std::vector<int> order(books);
+    for (long i = 0; i < books; ++i)
+        order[i] = static_cast<int>(i);
+    std::shuffle(order.begin(), order.end(), rng);
+
+    // Allocate in insertion order, as InsertBook would have.
+    SlabPool<Book> legacyBooks;
+    SlabPool<LegacyNode> legacyNodes;
+    std::vector<LegacyNode *> legacy(books);
+    for (int key : order)
+        legacy[key] = legacyNodes.create(legacyBooks.create(key, "Title", "Author", true));
+
+    SlabPool<Book> bookPool;
+    SlabPool<RBNode> nodePool;
+    std::vector<RBNode *> compact(books);
+    for (int key : order)
+        compact[key] = nodePool.create(key, bookPool.create(key, "Title", "Author", true));
+
+    LegacyNode *legacyRoot = link(legacy, 0, books - 1);
+    RBNode *compactRoot = link(compact, 0, books - 1);
+
+    std::vector<int> probes(lookups);
+    std::uniform_int_distribution<int> pick(0, static_cast<int>(books - 1));
+    for (int &key : probes)
+        key = pick(rng);
+
+    long long legacySum = 0, compactSum = 0;
+    double legacyNs = timeLookups(legacyRoot, probes, [](LegacyNode *n) { return n->book->bookID; }, legacySum);
+    double compactNs = timeLookups(compactRoot, probes, [](RBNode *n) { return n->key; }, compactSum);
+
+    std::printf("books=%ld lookups=%ld node bytes: legacy=%zu compact=%zu\n", books, lookups, sizeof(LegacyNode), sizeof(RBNode));
+    std::printf("legacy  (node->book->bookID): %8.1f ns/lookup\n", legacyNs);
+    std::printf("compact (inline bookID):      %8.1f ns/lookup  (%.2fx)\n", compactNs, legacyNs / compactNs);
+    if (legacySum != compactSum)
+    {
+        std::fprintf(stderr, "checksum mismatch\n");
+        return 1;
+    }
+
+    for (LegacyNode *node : legacy)
+    {
+        legacyBooks.destroy(node->book);
+        legacyNodes.destroy(node);
+    }
+    for (RBNode *node : compact)
+    {
+        bookPool.destroy(node->value);
+        nodePool.destroy(node);
+    }
+    return 0;
+}
@@ -0,0 +1,76 @@
+// Measures a full-range PrintBooks scan written through std::ofstream with a
+// std::endl per line (the old output path) and through OutputSink.
+//
+// Usage: bench_output [books] [output file]
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "gator_library.h"
+#include "output_sink.h"
+
+namespace
+{
+    void legacyPrintBook(const Book &book, std::ostream &output)
+    { // PrintBook's formatting as it was before OutputSink.
+
+        output << "\nBookID = " << book.bookID << std::endl;
+        output << "Title = "
+               << "\"" << book.bookName << "\"" << std::endl;
+        output << "Author = "
+               << "\"" << book.authorName << "\"" << std::endl;
+        output << "Availability = \"" << (book.availabilityStatus ? "Yes\"" : "No\"") << std::endl;
+        output << "BorrowedBy = " << (book.borrowedBy == -1 ? "None" : std::to_string(book.borrowedBy)) << std::endl;
+        output << "Reservations = [";
+        output << "]\n"
+               << std::endl;
+    }
+
+    template <typename Function>
+    double seconds(Function run)
+    {
+        auto start = std::chrono::steady_clock::now();
+        run();
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int books = argc > 1 ? std::atoi(argv[1]) : 200000;
+    std::string path = argc > 2 ? argv[2] : "bench_output.txt";
+
+    std::vector<std::string> titles;
+    std::vector<BookRecord> records;
+    titles.reserve(books);
+    for (int id = 0; id < books; ++id)
+        titles.push_back("Introduction to Algorithms, volume " + std::to_string(id));
+    for (int id = 0; id < books; ++id)
+        records.push_back({id, titles[id], "Thomas H. Cormen", true});
+    GatorLibrary library(records.begin(), records.end());
+
+    std::vector<Book> plain;
+    plain.reserve(books);
+    for (const BookRecord &record : records)
+        plain.emplace_back(record.bookID, record.bookName, record.authorName, true);
+
+    double legacy = seconds([&]
+                            {
+        std::ofstream output(path);
+        for (const Book &book : plain)
+            legacyPrintBook(book, output); });
+
+    double sink = seconds([&]
+                          {
+        OutputSink output(path);
+        library.PrintBooks(0, books - 1, output);
+        output.flush(); });
+
+    std::printf("PrintBooks over %d books\n", books);
+    std::printf("ofstream + std::endl: %7.3f s  %10.0f books/s\n", legacy, books / legacy);
+    std::printf("OutputSink:           %7.3f s  %10.0f books/s  (%.1fx)\n", sink, books / sink, legacy / sink);
+    std::remove(path.c_str());
+    return 0;
+}
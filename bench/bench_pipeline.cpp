@@ -0,0 +1,156 @@
+// Command log replay read, parsed and applied serially on one thread versus
+// through a CommandPipeline, with the output written by a BackgroundWriter.
+// Each stage is also timed on its own: the pipeline can at best run at the
+// speed of the slowest one, the serial loop at their sum. Every pipelined
+// run must write exactly the serial run's output.
+//
+// Usage: bench_pipeline [books] [operations] [command log]
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include "command_parser.h"
+#include "command_pipeline.h"
+#include "gator_library.h"
+#include "output_sink.h"
+#include "workload.h"
+
+namespace
+{
+    template <typename Function>
+    double seconds(Function run)
+    {
+        auto start = std::chrono::steady_clock::now();
+        run();
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    bool apply(GatorLibrary &library, const Command &command, OutputSink &output)
+    { // The commands writeCommandLog produces, as t1 runs them.
+
+        switch (command.type)
+        {
+        case CommandType::InsertBook:
+            library.InsertBook(command.integer(0), command.fields[1], command.fields[2], command.fields[3] == "Yes", -1);
+            break;
+        case CommandType::BorrowBook:
+            library.BorrowBook(command.integer(0), command.integer(1), command.integer(2), output);
+            break;
+        case CommandType::ReturnBook:
+            library.ReturnBook(command.integer(0), command.integer(1), output);
+            break;
+        case CommandType::DeleteBook:
+            library.DeleteBook(command.integer(0), output);
+            break;
+        case CommandType::PrintBooks:
+            library.PrintBooks(command.integer(0), command.integer(1), output);
+            break;
+        case CommandType::FindClosestBook:
+            library.FindClosestBook(command.integer(0), output);
+            break;
+        case CommandType::Quit:
+            return false;
+        default:
+            break;
+        }
+        return true;
+    }
+
+    std::string contents(const std::string &path)
+    {
+        std::ifstream file(path, std::ios::binary);
+        return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int books = argc > 1 ? std::atoi(argv[1]) : 200000;
+    long operations = argc > 2 ? std::atol(argv[2]) : 2000000;
+    std::string logPath = argc > 3 ? argv[3] : "bench_pipeline.log";
+    if (books < 1 || operations < 1)
+    {
+        std::fprintf(stderr, "need at least 1 book and 1 operation\n");
+        return 1;
+    }
+
+    WorkloadSpec spec;
+    spec.books = books;
+    spec.operations = operations;
+    if (!writeCommandLog(spec, generateWorkload(spec), logPath))
+    {
+        std::fprintf(stderr, "could not write %s\n", logPath.c_str());
+        return 1;
+    }
+    std::string serialPath = logPath + ".serial.out", pipelinedPath = logPath + ".pipelined.out";
+    double megabytes = 0;
+
+    // The stages alone.
+    double reading = seconds([&]
+                             {
+        int fd = ::open(logPath.c_str(), O_RDONLY);
+        std::unique_ptr<char[]> block(new char[CommandPipeline::kBlockSize]);
+        ssize_t got;
+        while ((got = ::read(fd, block.get(), CommandPipeline::kBlockSize)) > 0)
+            megabytes += got / 1e6;
+        ::close(fd); });
+    CommandParser parser(logPath);
+    std::vector<Command> commands;
+    double parsing = seconds([&]
+                             {
+        Command command;
+        while (parser.next(command))
+            commands.push_back(command); });
+    double applying = seconds([&]
+                              {
+        GatorLibrary library;
+        OutputSink output(-1);
+        for (const Command &command : commands)
+            if (!apply(library, command, output))
+                break; });
+    commands = std::vector<Command>();
+
+    std::printf("log %.1f MB, hardware threads=%u\n", megabytes, std::thread::hardware_concurrency());
+    std::printf("stage alone    read %8.0f ms   parse %8.0f ms   apply %8.0f ms\n", reading * 1e3, parsing * 1e3, applying * 1e3);
+
+    double serial = seconds([&]
+                            {
+        CommandParser input(logPath);
+        GatorLibrary library;
+        OutputSink output(serialPath);
+        Command command;
+        while (input.next(command) && apply(library, command, output))
+        {
+        } });
+    std::printf("%-22s %10.0f ms %10.1f MB/s\n", "serial", serial * 1e3, megabytes / serial);
+
+    std::string expected = contents(serialPath);
+    for (int parsers : {1, 2, 4})
+    {
+        double pipelined = seconds([&]
+                                   {
+            CommandPipeline pipeline(logPath, parsers);
+            GatorLibrary library;
+            OutputSink output(pipelinedPath);
+            BackgroundWriter writer;
+            writer.attach(output);
+            pipeline.run([&](const Command &command)
+                         { return apply(library, command, output); }); });
+        std::printf("pipeline, %d parser(s) %9.0f ms %10.1f MB/s\n", parsers, pipelined * 1e3, megabytes / pipelined);
+        if (contents(pipelinedPath) != expected)
+        {
+            std::fprintf(stderr, "pipelined output differs from the serial run\n");
+            return 1;
+        }
+    }
+    std::remove(serialPath.c_str());
+    std::remove(pipelinedPath.c_str());
+    return 0;
+}
@@ -0,0 +1,93 @@
+// Bulk range operations against their one-book-at-a-time equivalents:
+// DeleteRange over a run of IDs versus a DeleteBook per ID, and MergeLibrary
+// of a second branch versus inserting its books one by one. Both ways must
+// leave the libraries with the same number of books.
+//
+// Usage: bench_range [books] [range length] [rounds]
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+#include "gator_library.h"
+#include "output_sink.h"
+
+namespace
+{
+    double seconds(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    void load(GatorLibrary &library, int firstID, int books)
+    {
+        std::vector<BookRecord> records;
+        records.reserve(books);
+        for (int id = 0; id < books; ++id)
+            records.push_back({firstID + id, "Title", "Author", true});
+        library.BulkLoad(records.begin(), records.end());
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int books = argc > 1 ? std::atoi(argv[1]) : 1000000;
+    int length = argc > 2 ? std::atoi(argv[2]) : 1000;
+    int rounds = argc > 3 ? std::atoi(argv[3]) : 100;
+    if (books < 1 || length < 1 || rounds < 1 || static_cast<long long>(length) * rounds > books)
+    {
+        std::fprintf(stderr, "need at least 1 book, 1 ID per range and 1 round, and no more IDs deleted than books\n");
+        return 1;
+    }
+
+    std::mt19937 rng(42);
+    std::vector<int> starts;
+    for (int round = 0; round < rounds; ++round)
+        starts.push_back(round * (books / rounds) + static_cast<int>(rng() % (books / rounds - length + 1)));
+
+    GatorLibrary single, ranged;
+    load(single, 0, books);
+    load(ranged, 0, books);
+    OutputSink discard;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int first : starts)
+    {
+        for (int id = first; id < first + length; ++id)
+            single.DeleteBook(id, discard);
+        discard.clear();
+    }
+    double perBook = seconds(start);
+    start = std::chrono::steady_clock::now();
+    for (int first : starts)
+    {
+        ranged.DeleteRange(first, first + length - 1, discard);
+        discard.clear();
+    }
+    double perRange = seconds(start);
+    std::printf("delete %d x %d IDs    DeleteBook %10.1f us/range   DeleteRange %10.1f us/range\n", rounds, length,
+                perBook * 1e6 / rounds, perRange * 1e6 / rounds);
+    if (single.Size() != ranged.Size())
+    {
+        std::fprintf(stderr, "libraries disagree after deleting: %d vs %d books\n", single.Size(), ranged.Size());
+        return 1;
+    }
+
+    // A second branch with IDs above all of the first's, moved over both ways.
+    GatorLibrary branch;
+    load(branch, books, books);
+    start = std::chrono::steady_clock::now();
+    for (GatorLibrary::Cursor it = branch.First(); it.valid(); it.next())
+        single.InsertBook(it.bookID(), it.book().bookName, it.book().authorName, true, -1);
+    double inserted = seconds(start);
+    start = std::chrono::steady_clock::now();
+    bool merged = ranged.MergeLibrary(branch);
+    double mergedIn = seconds(start);
+    std::printf("merge %d books         InsertBook %10.1f ms         MergeLibrary %10.3f ms\n", books, inserted * 1e3, mergedIn * 1e3);
+    if (!merged || single.Size() != ranged.Size() || branch.Size() != 0)
+    {
+        std::fprintf(stderr, "libraries disagree after merging: %d vs %d books\n", single.Size(), ranged.Size());
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,271 @@
+// Compares the RBTree template GatorLibrary now uses against the tree code it
+// replaced, which was written directly against Book* and bookID: the same
+// inserts (random order, with subtree sizes) and the same findNode lookups.
+//
+// Usage: bench_rbtree [books] [lookups]
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+#include "gator_library.h"
+
+namespace
+{
+    struct alignas(64) LegacyNode
+    { // RBNode as it was before the template.
+        int bookID;
+        int size;
+        LegacyNode *left;
+        LegacyNode *right;
+        std::uintptr_t parentAndColor;
+        Book *book;
+
+        LegacyNode(Book *book) : bookID(book->bookID), size(1), left(nullptr), right(nullptr), parentAndColor(RED), book(book) {}
+
+        LegacyNode *parent() const { return reinterpret_cast<LegacyNode *>(parentAndColor & ~std::uintptr_t(1)); }
+        Color color() const { return static_cast<Color>(parentAndColor & 1); }
+        void setParent(LegacyNode *p) { parentAndColor = reinterpret_cast<std::uintptr_t>(p) | (parentAndColor & 1); }
+        void setColor(Color c) { parentAndColor = (parentAndColor & ~std::uintptr_t(1)) | c; }
+    };
+
+    class LegacyTree
+    { // GatorLibrary's insertRB, insertFixup, rotations and findNode, as they were.
+    public:
+        LegacyNode *root = nullptr;
+        SlabPool<LegacyNode> nodePool;
+        int colorFlipCount = 0;
+
+        static int sizeOf(const LegacyNode *node) { return node == nullptr ? 0 : node->size; }
+
+        void leftRotate(LegacyNode *x)
+        {
+            LegacyNode *y = x->right;
+            x->right = y->left;
+            if (y->left != nullptr)
+                y->left->setParent(x);
+            y->setParent(x->parent());
+            if (x->parent() == nullptr)
+                root = y;
+            else if (x == x->parent()->left)
+                x->parent()->left = y;
+            else
+                x->parent()->right = y;
+            y->left = x;
+            x->setParent(y);
+            y->size = x->size;
+            x->size = 1 + sizeOf(x->left) + sizeOf(x->right);
+        }
+
+        void rightRotate(LegacyNode *y)
+        {
+            LegacyNode *x = y->left;
+            y->left = x->right;
+            if (x->right != nullptr)
+                x->right->setParent(y);
+            x->setParent(y->parent());
+            if (y->parent() == nullptr)
+                root = x;
+            else if (y == y->parent()->left)
+                y->parent()->left = x;
+            else
+                y->parent()->right = x;
+            x->right = y;
+            y->setParent(x);
+            x->size = y->size;
+            y->size = 1 + sizeOf(y->left) + sizeOf(y->right);
+        }
+
+        void insertFixup(LegacyNode *z)
+        {
+            while (z != root && z->parent()->color() == RED)
+            {
+                if (z->parent() == z->parent()->parent()->left)
+                {
+                    LegacyNode *y = z->parent()->parent()->right;
+                    if (y && y->color() == RED)
+                    {
+                        z->parent()->setColor(BLACK);
+                        y->setColor(BLACK);
+                        z->parent()->parent()->setColor(RED);
+                        z = z->parent()->parent();
+                        colorFlipCount += 2;
+                    }
+                    else
+                    {
+                        if (z == z->parent()->right)
+                        {
+                            z = z->parent();
+                            leftRotate(z);
+                        }
+                        z->parent()->setColor(BLACK);
+                        z->parent()->parent()->setColor(RED);
+                        rightRotate(z->parent()->parent());
+                        colorFlipCount += 2;
+                    }
+                }
+                else
+                {
+                    LegacyNode *y = z->parent()->parent()->left;
+                    if (y && y->color() == RED)
+                    {
+                        z->parent()->setColor(BLACK);
+                        y->setColor(BLACK);
+                        z->parent()->parent()->setColor(RED);
+                        z = z->parent()->parent();
+                        colorFlipCount += 3;
+                    }
+                    else
+                    {
+                        if (z == z->parent()->left)
+                        {
+                            z = z->parent();
+                            rightRotate(z);
+                        }
+                        z->parent()->setColor(BLACK);
+                        z->parent()->parent()->setColor(RED);
+                        leftRotate(z->parent()->parent());
+                        colorFlipCount += 2;
+                    }
+                }
+            }
+            root->setColor(BLACK);
+        }
+
+        void insertRB(Book *book)
+        {
+            LegacyNode *z = nodePool.create(book);
+            LegacyNode *y = nullptr;
+            LegacyNode *x = root;
+            while (x != nullptr)
+            {
+                y = x;
+                x->size++;
+                if (z->bookID < x->bookID)
+                    x = x->left;
+                else
+                    x = x->right;
+            }
+            z->setParent(y);
+            if (y == nullptr)
+                root = z;
+            else if (z->bookID < y->bookID)
+                y->left = z;
+            else
+                y->right = z;
+            insertFixup(z);
+        }
+
+        LegacyNode *findNode(LegacyNode *node, int bookID) const
+        {
+            if (node == nullptr)
+                return nullptr;
+            if (bookID < node->bookID)
+                return findNode(node->left, bookID);
+            if (bookID > node->bookID)
+                return findNode(node->right, bookID);
+            return node;
+        }
+
+        void destroy(LegacyNode *node)
+        {
+            if (node == nullptr)
+                return;
+            destroy(node->left);
+            destroy(node->right);
+            nodePool.destroy(node);
+        }
+    };
+
+    double seconds(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    long books = argc > 1 ? std::atol(argv[1]) : 1000000;
+    long lookups = argc > 2 ? std::atol(argv[2]) : 5000000;
+
+    std::mt19937 rng(42);
+    std::vector<int> order(books);
+    for (long i = 0; i < books; ++i)
+        order[i] = static_cast<int>(i * 2);
+    std::shuffle(order.begin(), order.end(), rng);
+    std::vector<int> probes(lookups);
+    std::uniform_int_distribution<int> pick(0, static_cast<int>(books * 2 - 1)); // Half the probes miss.
+    for (int &key : probes)
+        key = pick(rng);
+
+    SlabPool<Book> bookPool;
+    std::vector<Book *> catalog(books);
+    for (long i = 0; i < books; ++i)
+        catalog[i] = bookPool.create(order[i], "Title", "Author", true);
+
+    // One tree at a time, alternating which goes first, and each one's best round is kept.
+    const int kRounds = 4;
+    double legacyInsert = 1e9, legacyFind = 1e9, treeInsert = 1e9, treeFind = 1e9;
+    long long legacyHits = 0, treeHits = 0;
+    int legacyFlips = 0, treeFlips = 0;
+    auto runLegacy = [&]
+    {
+        LegacyTree legacy;
+        auto start = std::chrono::steady_clock::now();
+        for (Book *book : catalog)
+            legacy.insertRB(book);
+        legacyInsert = std::min(legacyInsert, seconds(start));
+        legacyHits = 0;
+        start = std::chrono::steady_clock::now();
+        for (int key : probes)
+            if (LegacyNode *node = legacy.findNode(legacy.root, key))
+                legacyHits += node->book->bookID;
+        legacyFind = std::min(legacyFind, seconds(start));
+        legacyFlips = legacy.colorFlipCount;
+        legacy.destroy(legacy.root);
+    };
+    auto runTree = [&]
+    {
+        BookTree tree;
+        auto start = std::chrono::steady_clock::now();
+        for (Book *book : catalog)
+            tree.insert(book->bookID, book);
+        treeInsert = std::min(treeInsert, seconds(start));
+        treeHits = 0;
+        start = std::chrono::steady_clock::now();
+        for (int key : probes)
+            if (RBNode *node = tree.find(key))
+                treeHits += node->value->bookID;
+        treeFind = std::min(treeFind, seconds(start));
+        treeFlips = tree.colorFlips();
+    };
+    for (int round = 0; round < kRounds; ++round)
+    {
+        if (round % 2 == 0)
+        {
+            runLegacy();
+            runTree();
+        }
+        else
+        {
+            runTree();
+            runLegacy();
+        }
+    }
+    bool same = legacyHits == treeHits && legacyFlips == treeFlips;
+
+    std::printf("books=%ld lookups=%ld, best of %d\n", books, lookups, kRounds);
+    std::printf("  %-10s %14s %14s\n", "", "insert ns/op", "find ns/op");
+    std::printf("  %-10s %14.1f %14.1f\n", "legacy", legacyInsert * 1e9 / books, legacyFind * 1e9 / lookups);
+    std::printf("  %-10s %14.1f %14.1f\n", "RBTree", treeInsert * 1e9 / books, treeFind * 1e9 / lookups);
+
+    for (Book *book : catalog)
+        bookPool.destroy(book);
+    if (!same)
+    {
+        std::fprintf(stderr, "trees disagree\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,123 @@
+// Full-catalog exports running next to a writer. One thread keeps printing
+// every book while another inserts, deletes, borrows and returns, first with
+// the export going through the library (PrintBooks, which holds the tree lock
+// for the whole scan) and then through a pinned CatalogVersion (no lock). The
+// writer's throughput and worst call show how long the export holds it up; a
+// writer-only run with and without versions gives the cost of publishing.
+//
+// Usage: bench_versions [books] [writer ops]
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <thread>
+#include <vector>
+#include "gator_library.h"
+#include "output_sink.h"
+
+namespace
+{
+    enum class Export
+    {
+        None,
+        Locked,
+        Pinned
+    };
+
+    struct Result
+    {
+        double opsPerSecond;
+        double worstUs;
+        long exports;
+    };
+
+    Result run(int books, long ops, bool versions, Export exporting)
+    {
+        std::vector<BookRecord> records;
+        records.reserve(books);
+        for (int id = 0; id < books; ++id)
+            records.push_back({id * 2, "Title", "Author", true}); // Even IDs; the writer inserts and deletes odd ones.
+        GatorLibrary library(true);
+        library.BulkLoad(records.begin(), records.end());
+        library.SetQueryCacheBudget(0);
+        if (versions)
+            library.EnableVersions();
+
+        std::atomic<bool> done(false);
+        long exports = 0;
+        std::thread exporter([&]
+                             {
+            OutputSink discard(-1, 1 << 16);
+            while (exporting != Export::None && !done.load(std::memory_order_acquire))
+            {
+                if (exporting == Export::Locked)
+                    library.PrintBooks(INT_MIN, INT_MAX, discard);
+                else
+                    library.Pin().PrintBooks(INT_MIN, INT_MAX, discard);
+                ++exports;
+            } });
+
+        std::mt19937 rng(42);
+        std::uniform_int_distribution<int> pick(0, books - 1);
+        OutputSink discard(-1, 1 << 16);
+        double worst = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (long i = 0; i < ops; ++i)
+        {
+            int key = pick(rng);
+            auto began = std::chrono::steady_clock::now();
+            switch (i % 4)
+            {
+            case 0:
+                library.InsertBook(key * 2 + 1, "New", "Author", true, -1);
+                break;
+            case 1:
+                library.DeleteBook(key * 2 + 1, discard);
+                break;
+            case 2:
+                library.BorrowBook(1, key * 2, 1, discard);
+                break;
+            default:
+                library.ReturnBook(1, key * 2, discard);
+                break;
+            }
+            worst = std::max(worst, std::chrono::duration<double>(std::chrono::steady_clock::now() - began).count());
+        }
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        done.store(true, std::memory_order_release);
+        exporter.join();
+        return {ops / elapsed, worst * 1e6, exports};
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int books = argc > 1 ? std::atoi(argv[1]) : 1000000;
+    long ops = argc > 2 ? std::atol(argv[2]) : 200000;
+    if (books < 1 || ops < 1)
+    {
+        std::fprintf(stderr, "need at least 1 book and 1 writer op\n");
+        return 1;
+    }
+
+    std::printf("books=%d writer ops=%ld hardware threads=%u\n", books, ops, std::thread::hardware_concurrency());
+    std::printf("%-28s %14s %16s %10s\n", "mode", "writer ops/s", "worst call us", "exports");
+    struct
+    {
+        const char *name;
+        bool versions;
+        Export exporting;
+    } modes[] = {{"writer alone", false, Export::None},
+                 {"writer alone, versions on", true, Export::None},
+                 {"export via PrintBooks", false, Export::Locked},
+                 {"export via Pin", true, Export::Pinned}};
+    for (const auto &mode : modes)
+    {
+        Result result = run(books, ops, mode.versions, mode.exporting);
+        std::printf("%-28s %14.0f %16.1f %10ld\n", mode.name, result.opsPerSecond, result.worstUs, result.exports);
+    }
+    return 0;
+}
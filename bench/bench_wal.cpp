@@ -0,0 +1,64 @@
+// Measures BorrowBook/ReturnBook throughput with a write-ahead log attached,
+// for several group-commit batch sizes, against the same run without a log.
+//
+// Usage: bench_wal [operations] [log file]
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include "gator_library.h"
+#include "output_sink.h"
+#include "write_ahead_log.h"
+
+namespace
+{
+    const int kBooks = 1024;
+
+    double run(long operations, WriteAheadLog *log)
+    { // Seconds taken by `operations` alternating borrows and returns.
+
+        std::vector<BookRecord> records;
+        for (int id = 0; id < kBooks; ++id)
+            records.push_back({id, "Title", "Author", true});
+        GatorLibrary library(records.begin(), records.end());
+        library.AttachLog(log);
+        OutputSink discard(-1, 1 << 16);
+
+        auto start = std::chrono::steady_clock::now();
+        for (long i = 0; i < operations; ++i)
+        {
+            int bookID = static_cast<int>(i / 2 % kBooks);
+            if (i % 2 == 0)
+                library.BorrowBook(7, bookID, 1, discard);
+            else
+                library.ReturnBook(7, bookID, discard);
+        }
+        if (log)
+            log->commit();
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    long operations = argc > 1 ? std::atol(argv[1]) : 20000;
+    std::string path = argc > 2 ? argv[2] : "bench_wal.log";
+
+    double seconds = run(operations, nullptr);
+    std::printf("%-14s %12.0f ops/s\n", "no log", operations / seconds);
+    for (std::size_t batch : {1, 8, 64, 512})
+    {
+        WriteAheadLog log(batch, std::chrono::milliseconds(1000));
+        if (!log.open(path, 0, 0))
+        {
+            std::fprintf(stderr, "could not open %s\n", path.c_str());
+            return 1;
+        }
+        seconds = run(operations, &log);
+        std::printf("batch %-8zu %12.0f ops/s %8llu fsyncs\n", batch, operations / seconds,
+                    static_cast<unsigned long long>(log.commitCount()));
+    }
+    std::remove(path.c_str());
+    return 0;
+}
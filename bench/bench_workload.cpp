@@ -0,0 +1,212 @@
+// Replays synthetic workloads (see workload.h) against GatorLibrary and reports
+// throughput and p50/p99 latency per operation type. Every distribution runs
+// in a child process, so its peak RSS is its own. The operation types are
+// interleaved, so memory is not told apart by type: the "proc RSS KiB" column
+// is the whole process's resident set, the highest seen while that type ran.
+//
+// Usage: bench_workload [--mix i,b,r,d,p,f] [books] [operations] [sequential|uniform|zipfian|storm|all] [command log]
+// --mix sets the relative weights of InsertBook, BorrowBook, ReturnBook,
+// DeleteBook, PrintBooks and FindClosestBook for every workload run, in place
+// of each one's built-in mix. With a command log path the (single) workload is
+// also written out for t1.
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "gator_library.h"
+#include "output_sink.h"
+#include "workload.h"
+
+namespace
+{
+    struct Scenario
+    {
+        const char *name;
+        KeyDistribution keys;
+        WorkloadMix mix;
+    };
+
+    const Scenario kScenarios[] = {
+        {"sequential", KeyDistribution::Sequential, {{10, 30, 25, 5, 10, 20}}},
+        {"uniform", KeyDistribution::Uniform, {{10, 30, 25, 5, 10, 20}}},
+        {"zipfian", KeyDistribution::Zipfian, {{10, 30, 25, 5, 10, 20}}},
+        {"storm", KeyDistribution::HotBook, {{2, 60, 30, 1, 2, 5}}},
+    };
+
+    bool parseMix(const char *text, WorkloadMix &mix)
+    { // Reads comma-separated weights, one per operation type; at least one must be positive.
+
+        int total = 0;
+        for (int type = 0; type < static_cast<int>(OpType::Count); ++type)
+        {
+            char *end;
+            long weight = std::strtol(text, &end, 10);
+            if (end == text || weight < 0 || weight > 1000000 || *end != (type + 1 < static_cast<int>(OpType::Count) ? ',' : '\0'))
+                return false;
+            mix.weights[type] = static_cast<int>(weight);
+            total += mix.weights[type];
+            text = end + 1;
+        }
+        return total > 0;
+    }
+
+    long residentKiB()
+    { // Current resident set, from /proc/self/statm.
+
+        long pages = 0, resident = 0;
+        if (std::FILE *statm = std::fopen("/proc/self/statm", "r"))
+        {
+            if (std::fscanf(statm, "%ld %ld", &pages, &resident) != 2)
+                resident = 0;
+            std::fclose(statm);
+        }
+        return resident * (sysconf(_SC_PAGESIZE) / 1024);
+    }
+
+    struct OpStats
+    {
+        std::vector<std::uint32_t> nanos;
+        double seconds = 0;
+        long peakKiB = 0;
+
+        double percentile(double p)
+        {
+            if (nanos.empty())
+                return 0;
+            auto at = nanos.begin() + static_cast<long>(p * (nanos.size() - 1));
+            std::nth_element(nanos.begin(), at, nanos.end());
+            return *at / 1000.0;
+        }
+    };
+
+    void run(const Scenario &scenario, const WorkloadMix &mix, int books, long operations, const char *logPath)
+    {
+        WorkloadSpec spec;
+        spec.books = books;
+        spec.operations = operations;
+        spec.keys = scenario.keys;
+        spec.mix = mix;
+        std::vector<Operation> ops = generateWorkload(spec);
+        if (logPath && !writeCommandLog(spec, ops, logPath))
+            std::fprintf(stderr, "could not write %s\n", logPath);
+
+        std::vector<std::string> names;
+        std::vector<BookRecord> records;
+        names.reserve(books);
+        for (int id = 0; id < books; ++id)
+            names.push_back("Book " + std::to_string(id * 2));
+        for (int id = 0; id < books; ++id)
+            records.push_back({id * 2, names[id], "Author", true});
+        GatorLibrary library(records.begin(), records.end());
+
+        OutputSink discard(-1, 1 << 16);
+        OpStats stats[static_cast<int>(OpType::Count)];
+        for (OpStats &stat : stats)
+            stat.nanos.reserve(operations / 4);
+
+        auto start = std::chrono::steady_clock::now();
+        for (const Operation &op : ops)
+        {
+            OpStats &stat = stats[static_cast<int>(op.type)];
+            auto before = std::chrono::steady_clock::now();
+            switch (op.type)
+            {
+            case OpType::Insert:
+                library.InsertBook(op.bookID, "Inserted", "Author", true, -1);
+                break;
+            case OpType::Borrow:
+                library.BorrowBook(op.patronID, op.bookID, op.extra, discard);
+                break;
+            case OpType::Return:
+                library.ReturnBook(op.patronID, op.bookID, discard);
+                break;
+            case OpType::Delete:
+                library.DeleteBook(op.bookID, discard);
+                break;
+            case OpType::PrintBooks:
+                library.PrintBooks(op.bookID, op.extra, discard);
+                break;
+            case OpType::FindClosest:
+                library.FindClosestBook(op.bookID, discard);
+                break;
+            default:
+                break;
+            }
+            auto elapsed = std::chrono::steady_clock::now() - before;
+            stat.seconds += std::chrono::duration<double>(elapsed).count();
+            stat.nanos.push_back(static_cast<std::uint32_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+            if ((stat.nanos.size() & 1023) == 0) // Sampling /proc on every operation would swamp the timings.
+                stat.peakKiB = std::max(stat.peakKiB, residentKiB());
+        }
+        double total = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        std::printf("%s: %d books, %ld ops, %.0f ops/s overall, peak RSS %ld KiB\n", scenario.name, books, operations, operations / total, usage.ru_maxrss);
+        std::printf("  %-16s %10s %12s %10s %10s %12s\n", "operation", "count", "ops/s", "p50 us", "p99 us", "proc RSS KiB");
+        for (int type = 0; type < static_cast<int>(OpType::Count); ++type)
+        {
+            OpStats &stat = stats[type];
+            if (stat.nanos.empty())
+                continue;
+            std::printf("  %-16s %10zu %12.0f %10.3f %10.3f %12ld\n", opName(static_cast<OpType>(type)), stat.nanos.size(),
+                        stat.nanos.size() / stat.seconds, stat.percentile(0.50), stat.percentile(0.99), std::max(stat.peakKiB, residentKiB()));
+        }
+        std::fflush(stdout);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    WorkloadMix mix{};
+    bool mixGiven = argc > 1 && std::strcmp(argv[1], "--mix") == 0;
+    if (mixGiven && (argc < 3 || !parseMix(argv[2], mix)))
+    {
+        std::fprintf(stderr, "--mix needs %d comma-separated weights, not all zero\n", static_cast<int>(OpType::Count));
+        return 1;
+    }
+    int arg = mixGiven ? 3 : 1;
+    int books = argc > arg ? std::atoi(argv[arg]) : 100000;
+    long operations = argc > arg + 1 ? std::atol(argv[arg + 1]) : 1000000;
+    std::string which = argc > arg + 2 ? argv[arg + 2] : "all";
+    const char *logPath = argc > arg + 3 ? argv[arg + 3] : nullptr;
+    if (books < 8 || operations < 1)
+    {
+        std::fprintf(stderr, "need at least 8 books and 1 operation\n");
+        return 1;
+    }
+
+    bool matched = false;
+    for (const Scenario &scenario : kScenarios)
+    {
+        if (which != "all" && which != scenario.name)
+            continue;
+        matched = true;
+        std::fflush(stdout);
+        pid_t child = fork();
+        if (child == 0)
+        {
+            run(scenario, mixGiven ? mix : scenario.mix, books, operations, which == "all" ? nullptr : logPath);
+            std::_Exit(0);
+        }
+        int status = 0;
+        if (child < 0 || waitpid(child, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        {
+            std::fprintf(stderr, "%s: benchmark run failed\n", scenario.name);
+            return 1;
+        }
+    }
+    if (!matched)
+    {
+        std::fprintf(stderr, "unknown workload: %s\n", which.c_str());
+        return 1;
+    }
+    return 0;
+}
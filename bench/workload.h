@@ -0,0 +1,196 @@
+#ifndef BENCH_WORKLOAD_H
+#define BENCH_WORKLOAD_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+// Synthetic workloads for the library benchmarks. A workload is a preload of
+// `books` books (even IDs 0, 2, 4, ...) followed by a stream of operations
+// whose keys follow one of the distributions below. The same workload can be
+// written out as a command log, so t1 itself can replay it.
+
+enum class KeyDistribution
+{
+    Sequential, // Keys walk 0, 1, 2, ... and wrap; inserts append past the end.
+    Uniform,
+    Zipfian,   // Skewed towards a few popular books (theta 0.99, scrambled over the key space).
+    HotBook    // Reservation storm: most traffic lands on a handful of books.
+};
+
+enum class OpType
+{
+    Insert,
+    Borrow,
+    Return,
+    Delete,
+    PrintBooks,
+    FindClosest,
+    Count
+};
+
+inline const char *opName(OpType type)
+{
+    static const char *const names[] = {"InsertBook", "BorrowBook", "ReturnBook", "DeleteBook", "PrintBooks", "FindClosestBook"};
+    return names[static_cast<int>(type)];
+}
+
+struct WorkloadMix
+{ // Relative weights of each operation type, in OpType order.
+    int weights[static_cast<int>(OpType::Count)];
+};
+
+struct WorkloadSpec
+{
+    int books = 100000;
+    long operations = 1000000;
+    KeyDistribution keys = KeyDistribution::Uniform;
+    WorkloadMix mix = {{10, 30, 25, 5, 10, 20}};
+    int rangeWidth = 32; // PrintBooks spans this many IDs.
+    int hotBooks = 8;
+    int patrons = 10000;
+    unsigned seed = 1;
+};
+
+struct Operation
+{
+    OpType type;
+    int bookID;
+    int extra; // PrintBooks: end of the range. BorrowBook: priority.
+    int patronID;
+};
+
+// Zipfian ranks in [0, n) after Gray et al., "Quickly Generating
+// Billion-Record Synthetic Databases". Rank 0 is the most popular.
+class ZipfianGenerator
+{
+private:
+    long n;
+    double theta, alpha, zetan, eta;
+
+    static double zeta(long n, double theta)
+    {
+        double sum = 0;
+        for (long i = 1; i <= n; ++i)
+            sum += 1.0 / std::pow(static_cast<double>(i), theta);
+        return sum;
+    }
+
+public:
+    explicit ZipfianGenerator(long n, double theta = 0.99)
+        : n(n), theta(theta), alpha(1.0 / (1.0 - theta)), zetan(zeta(n, theta))
+    {
+        eta = (1.0 - std::pow(2.0 / n, 1.0 - theta)) / (1.0 - zeta(2, theta) / zetan);
+    }
+
+    template <typename Rng>
+    long operator()(Rng &rng)
+    {
+        double u = std::uniform_real_distribution<double>(0.0, 1.0)(rng);
+        double uz = u * zetan;
+        if (uz < 1.0)
+            return 0;
+        if (uz < 1.0 + std::pow(0.5, theta))
+            return 1;
+        return std::min(n - 1, static_cast<long>(n * std::pow(eta * u - eta + 1.0, alpha)));
+    }
+};
+
+inline std::vector<Operation> generateWorkload(const WorkloadSpec &spec)
+{ // Builds the operation stream for spec; the preload is implied by spec.books.
+
+    std::mt19937_64 rng(spec.seed);
+    std::discrete_distribution<int> pickType(std::begin(spec.mix.weights), std::end(spec.mix.weights));
+    std::uniform_int_distribution<int> uniform(0, spec.books - 1);
+    std::uniform_int_distribution<int> patron(1, spec.patrons);
+    std::uniform_int_distribution<int> priority(1, 20);
+    ZipfianGenerator zipf(spec.keys == KeyDistribution::Zipfian ? spec.books : 2);
+    int sequential = 0;
+    int appended = spec.books;
+
+    auto nextKey = [&]
+    {
+        switch (spec.keys)
+        {
+        case KeyDistribution::Sequential:
+            return sequential = (sequential + 1) % spec.books;
+        case KeyDistribution::Zipfian:
+            return static_cast<int>((zipf(rng) * 2654435761u) % static_cast<unsigned long>(spec.books)); // Spread popular keys over the tree.
+        case KeyDistribution::HotBook:
+            return rng() % 10 != 0 ? static_cast<int>(rng() % spec.hotBooks) * (spec.books / spec.hotBooks) : uniform(rng);
+        default:
+            return uniform(rng);
+        }
+    };
+
+    std::vector<Operation> operations;
+    operations.reserve(spec.operations);
+    for (long i = 0; i < spec.operations; ++i)
+    {
+        OpType type = static_cast<OpType>(pickType(rng));
+        int key = nextKey();
+        Operation op{type, key * 2, 0, patron(rng)};
+        switch (type)
+        {
+        case OpType::Insert:
+            op.bookID = spec.keys == KeyDistribution::Sequential ? 2 * appended++ : key * 2 + 1; // Odd IDs never collide with the preload.
+            break;
+        case OpType::Borrow:
+            op.extra = priority(rng);
+            break;
+        case OpType::PrintBooks:
+            op.extra = op.bookID + spec.rangeWidth - 1;
+            break;
+        case OpType::FindClosest:
+            op.bookID = key * 2 + 1;
+            break;
+        default:
+            break;
+        }
+        operations.push_back(op);
+    }
+    return operations;
+}
+
+inline bool writeCommandLog(const WorkloadSpec &spec, const std::vector<Operation> &operations, const std::string &path)
+{ // Writes the preload and the operations in t1's input format.
+
+    std::FILE *file = std::fopen(path.c_str(), "w");
+    if (!file)
+        return false;
+    for (int id = 0; id < spec.books; ++id)
+        std::fprintf(file, "InsertBook(%d, \"Book %d\", \"Author %d\", \"Yes\")\n", id * 2, id * 2, id % 997);
+    for (const Operation &op : operations)
+    {
+        switch (op.type)
+        {
+        case OpType::Insert:
+            std::fprintf(file, "InsertBook(%d, \"Book %d\", \"Author %d\", \"Yes\")\n", op.bookID, op.bookID, op.bookID % 997);
+            break;
+        case OpType::Borrow:
+            std::fprintf(file, "BorrowBook(%d, %d, %d)\n", op.patronID, op.bookID, op.extra);
+            break;
+        case OpType::Return:
+            std::fprintf(file, "ReturnBook(%d, %d)\n", op.patronID, op.bookID);
+            break;
+        case OpType::Delete:
+            std::fprintf(file, "DeleteBook(%d)\n", op.bookID);
+            break;
+        case OpType::PrintBooks:
+            std::fprintf(file, "PrintBooks(%d, %d)\n", op.bookID, op.extra);
+            break;
+        case OpType::FindClosest:
+            std::fprintf(file, "FindClosestBook(%d)\n", op.bookID);
+            break;
+        default:
+            break;
+        }
+    }
+    std::fprintf(file, "Quit()\n");
+    return std::fclose(file) == 0;
+}
+
+#endif
@@ -0,0 +1,807 @@
+#ifndef BPLUS_TREE_H
+#define BPLUS_TREE_H
+
+#include <algorithm>
+#include <climits>
+#include <cstddef>
+#include <vector>
+#include "slab_pool.h"
+#include "stats.h"
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+// B+-tree over int keys with wide nodes: 64 sorted keys per node, searched
+// with SIMD compares (AVX2 when the build enables it, SSE2 otherwise) instead
+// of one dependent load per level. Leaves are linked both ways for in-order
+// stepping, and every inner node keeps the entry count of each child, so rank
+// and select are O(log n) as well.
+//
+// Equal keys are kept in insertion order and find() returns the first.
+// Every node but the root is kept at least half full. A node that a delete
+// leaves short evens out with a sibling, or merges into it when the two fit
+// in one node with a slot to spare, and its parent is mended the same way in
+// turn. Bulk builds and joins mend the few short nodes they make the same way.
+template <typename Value>
+class BPlusTree
+{
+public:
+    static constexpr int kSlots = 64;
+    static constexpr int kHalf = kSlots / 2;
+
+    struct Inner;
+
+    struct Node
+    {
+        Inner *parent = nullptr;
+        int count = 0; // Entries in a leaf, children in an inner node.
+        bool leaf;
+
+        explicit Node(bool leaf) : leaf(leaf) {}
+    };
+
+    // Key slots past `count` always hold INT_MAX, so whole SIMD blocks can be compared.
+    struct alignas(64) Leaf : Node
+    {
+        int keys[kSlots];
+        Value values[kSlots];
+        Leaf *prev = nullptr;
+        Leaf *next = nullptr;
+
+        Leaf() : Node(true) { std::fill(keys, keys + kSlots, INT_MAX); }
+    };
+
+    // keys[i] is the smallest key of children[i + 1] when it was split off.
+    struct alignas(64) Inner : Node
+    {
+        int keys[kSlots];
+        Node *children[kSlots];
+        int sizes[kSlots]; // Entries under each child.
+
+        Inner() : Node(false) { std::fill(keys, keys + kSlots, INT_MAX); }
+    };
+
+    // Position of one entry; invalidated by any insert or erase.
+    class Cursor
+    {
+    private:
+        Leaf *at = nullptr;
+        int index = 0;
+
+    public:
+        Cursor() = default;
+        Cursor(Leaf *leaf, int slot) : at(leaf), index(slot) {}
+
+        bool valid() const { return at != nullptr; }
+        int key() const { return at->keys[index]; }
+        Value value() const { return at->values[index]; }
+        Leaf *leaf() const { return at; }
+        int slot() const { return index; }
+
+        Cursor &next()
+        {
+            if (++index == at->count)
+            {
+                at = at->next;
+                index = 0;
+            }
+            return *this;
+        }
+
+        Cursor &prev()
+        {
+            if (index-- == 0)
+            {
+                at = at->prev;
+                index = at ? at->count - 1 : 0;
+            }
+            return *this;
+        }
+    };
+
+private:
+    Node *root = nullptr;
+    Leaf *head = nullptr;
+    Leaf *tail = nullptr;
+    int total = 0;
+    int levels = 0; // Height of the tree, counting the leaves.
+    SlabPool<Leaf, 512> leaves;
+    SlabPool<Inner, 64> inners;
+    mutable TreeCounters stats;
+
+    static int countLess(const int *keys, int used, int key)
+    { // Number of keys[0..used) below key. Keys are sorted, so the scan stops at the first block that is not all below.
+
+        int below = 0;
+#if defined(__AVX2__)
+        __m256i target = _mm256_set1_epi32(key);
+        for (int i = 0; i < used; i += 8)
+        {
+            __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(keys + i));
+            int hits = __builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(target, block))));
+            below += hits;
+            if (hits < 8)
+                break;
+        }
+#elif defined(__SSE2__)
+        __m128i target = _mm_set1_epi32(key);
+        for (int i = 0; i < used; i += 4)
+        {
+            __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(keys + i));
+            int hits = __builtin_popcount(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(target, block))));
+            below += hits;
+            if (hits < 4)
+                break;
+        }
+#else
+        while (below < used && keys[below] < key)
+            ++below;
+#endif
+        return below < used ? below : used;
+    }
+
+    static int countLessEqual(const int *keys, int used, int key)
+    { // Number of keys[0..used) at most key.
+
+        if (key == INT_MAX)
+            return used;
+        return countLess(keys, used, key + 1);
+    }
+
+    static int slotOf(const Inner *parent, const Node *child)
+    {
+        int slot = 0;
+        while (parent->children[slot] != child)
+            ++slot;
+        return slot;
+    }
+
+    static int sum(const int *sizes, int count)
+    {
+        int entries = 0;
+        for (int i = 0; i < count; ++i)
+            entries += sizes[i];
+        return entries;
+    }
+
+    static int sizeOf(const Node *node)
+    {
+        return node->leaf ? node->count : sum(static_cast<const Inner *>(node)->sizes, node->count);
+    }
+
+    void adjustSizes(Node *node, int delta)
+    { // Adds delta to the recorded size of node in every ancestor.
+
+        for (Inner *parent = node->parent; parent != nullptr; node = parent, parent = parent->parent)
+            parent->sizes[slotOf(parent, node)] += delta;
+    }
+
+    void linkSibling(Node *left, int separator, Node *right)
+    { // Puts right, which holds entries just moved out of left, after left in left's parent.
+      // The entries stay under the same parent, so the counts further up do not change.
+
+        Inner *parent = left->parent;
+        if (parent == nullptr)
+        {
+            parent = inners.create();
+            parent->children[0] = left;
+            parent->count = 1;
+            left->parent = parent;
+            root = parent;
+            ++levels;
+        }
+        else if (parent->count == kSlots)
+        {
+            Inner *sibling = inners.create();
+            int half = kSlots / 2;
+            int separatorUp = parent->keys[half - 1];
+            sibling->count = kSlots - half;
+            for (int i = 0; i < sibling->count; ++i)
+            {
+                sibling->children[i] = parent->children[half + i];
+                sibling->sizes[i] = parent->sizes[half + i];
+                sibling->children[i]->parent = sibling;
+            }
+            for (int i = 0; i < sibling->count - 1; ++i)
+                sibling->keys[i] = parent->keys[half + i];
+            std::fill(parent->keys + half - 1, parent->keys + kSlots, INT_MAX);
+            parent->count = half;
+            linkSibling(parent, separatorUp, sibling);
+            parent = left->parent;
+            stats.splits.add();
+        }
+
+        int slot = slotOf(parent, left) + 1;
+        for (int i = parent->count; i > slot; --i)
+        {
+            parent->children[i] = parent->children[i - 1];
+            parent->sizes[i] = parent->sizes[i - 1];
+        }
+        for (int i = parent->count - 1; i > slot - 1; --i)
+            parent->keys[i] = parent->keys[i - 1];
+        parent->children[slot] = right;
+        parent->keys[slot - 1] = separator;
+        ++parent->count;
+        right->parent = parent;
+        parent->sizes[slot - 1] = sizeOf(left);
+        parent->sizes[slot] = sizeOf(right);
+    }
+
+    Leaf *splitLeaf(Leaf *leaf)
+    { // Moves the upper half of a full leaf into a new leaf after it.
+
+        Leaf *right = leaves.create();
+        int half = kSlots / 2;
+        right->count = kSlots - half;
+        for (int i = 0; i < right->count; ++i)
+        {
+            right->keys[i] = leaf->keys[half + i];
+            right->values[i] = leaf->values[half + i];
+        }
+        std::fill(leaf->keys + half, leaf->keys + kSlots, INT_MAX);
+        leaf->count = half;
+        right->prev = leaf;
+        right->next = leaf->next;
+        (leaf->next ? leaf->next->prev : tail) = right;
+        leaf->next = right;
+        linkSibling(leaf, right->keys[0], right);
+        stats.splits.add();
+        return right;
+    }
+
+    void removeChild(Inner *parent, int slot)
+    { // Drops an empty child; an inner node left with no children goes too.
+
+        for (int i = slot; i < parent->count - 1; ++i)
+        {
+            parent->children[i] = parent->children[i + 1];
+            parent->sizes[i] = parent->sizes[i + 1];
+        }
+        int key = slot == 0 ? 0 : slot - 1;
+        for (int i = key; i < parent->count - 2; ++i)
+            parent->keys[i] = parent->keys[i + 1];
+        --parent->count;
+        if (parent->count > 0)
+            parent->keys[parent->count - 1] = INT_MAX;
+        if (parent->count == 0 && parent->parent != nullptr)
+        {
+            Inner *grandparent = parent->parent;
+            removeChild(grandparent, slotOf(grandparent, parent));
+            inners.destroy(parent);
+        }
+    }
+
+    void shareLeaves(Inner *parent, int slot, int leftCount)
+    { // Deals the entries of the leaves at slot and slot + 1 out again, leftCount to the left one.
+      // Their parent's total does not change, so the counts further up stay.
+
+        Leaf *left = static_cast<Leaf *>(parent->children[slot]);
+        Leaf *right = static_cast<Leaf *>(parent->children[slot + 1]);
+        int keys[2 * kSlots];
+        Value values[2 * kSlots];
+        int n = 0;
+        for (Leaf *leaf : {left, right})
+            for (int i = 0; i < leaf->count; ++i, ++n)
+            {
+                keys[n] = leaf->keys[i];
+                values[n] = leaf->values[i];
+            }
+        left->count = leftCount;
+        right->count = n - leftCount;
+        for (int i = 0; i < kSlots; ++i)
+        {
+            left->keys[i] = i < left->count ? keys[i] : INT_MAX;
+            right->keys[i] = i < right->count ? keys[leftCount + i] : INT_MAX;
+        }
+        std::copy(values, values + left->count, left->values);
+        std::copy(values + leftCount, values + n, right->values);
+        parent->sizes[slot] = left->count;
+        parent->sizes[slot + 1] = right->count;
+        if (right->count > 0)
+            parent->keys[slot] = right->keys[0];
+    }
+
+    void shareInners(Inner *parent, int slot, int leftCount)
+    { // shareLeaves() for two inner nodes: leftCount children to the left one. The separator
+      // between them comes down from the parent and the new one goes up in its place.
+
+        Inner *left = static_cast<Inner *>(parent->children[slot]);
+        Inner *right = static_cast<Inner *>(parent->children[slot + 1]);
+        Node *children[2 * kSlots];
+        int sizes[2 * kSlots];
+        int keys[2 * kSlots]; // keys[i] separates children[i] and children[i + 1].
+        int n = 0;
+        for (Inner *inner : {left, right})
+        {
+            if (inner == right)
+                keys[n - 1] = parent->keys[slot];
+            for (int i = 0; i < inner->count; ++i, ++n)
+            {
+                children[n] = inner->children[i];
+                sizes[n] = inner->sizes[i];
+                if (i + 1 < inner->count)
+                    keys[n] = inner->keys[i];
+            }
+        }
+        left->count = leftCount;
+        right->count = n - leftCount;
+        for (int i = 0; i < kSlots; ++i)
+        {
+            left->keys[i] = i + 1 < left->count ? keys[i] : INT_MAX;
+            right->keys[i] = i + 1 < right->count ? keys[leftCount + i] : INT_MAX;
+        }
+        for (int i = 0; i < n; ++i)
+        {
+            Inner *owner = i < leftCount ? left : right;
+            int at = i < leftCount ? i : i - leftCount;
+            owner->children[at] = children[i];
+            owner->sizes[at] = sizes[i];
+            children[i]->parent = owner;
+        }
+        parent->sizes[slot] = sum(left->sizes, left->count);
+        parent->sizes[slot + 1] = sum(right->sizes, right->count);
+        if (right->count > 0)
+            parent->keys[slot] = keys[leftCount - 1];
+    }
+
+    Node *rebalance(Node *node)
+    { // node is under half full and has a sibling. The two are merged if they fit in one node
+      // with a slot to spare, or else evened out. Returns the node now holding node's entries.
+
+        Inner *parent = node->parent;
+        int slot = slotOf(parent, node);
+        int left = slot > 0 ? slot - 1 : slot; // The pair is children[left] and children[left + 1].
+        Node *right = parent->children[left + 1];
+        int combined = parent->children[left]->count + right->count;
+        int leftCount = combined < kSlots ? combined : combined / 2;
+        if (node->leaf)
+            shareLeaves(parent, left, leftCount);
+        else
+            shareInners(parent, left, leftCount);
+        if (right->count > 0)
+            return node;
+        if (right->leaf)
+        {
+            Leaf *gone = static_cast<Leaf *>(right);
+            (gone->next ? gone->next->prev : tail) = gone->prev;
+            gone->prev->next = gone->next;
+            leaves.destroy(gone);
+        }
+        else
+            inners.destroy(static_cast<Inner *>(right));
+        removeChild(parent, left + 1);
+        stats.merges.add();
+        return parent->children[left];
+    }
+
+    void restore(Node *node)
+    { // Brings node, then each of its ancestors, back to at least half full. A node whose parent
+      // has no other child waits until the parent is mended, which gives it a sibling.
+      // Call collapseRoot() afterwards.
+
+        while (node != root)
+        {
+            Inner *parent = node->parent;
+            if (node->count >= kHalf)
+                node = parent;
+            else if (parent->count > 1)
+                node = rebalance(node)->parent;
+            else if (parent == root)
+                collapseRoot(); // node becomes the root.
+            else
+                restore(parent);
+        }
+    }
+
+    void dropLeaf(Leaf *leaf)
+    { // Frees an emptied leaf whose entries are already gone from the counts above it.
+
+        (leaf->prev ? leaf->prev->next : head) = leaf->next;
+        (leaf->next ? leaf->next->prev : tail) = leaf->prev;
+        removeChild(leaf->parent, slotOf(leaf->parent, leaf));
+        leaves.destroy(leaf);
+    }
+
+    void collapseRoot()
+    { // A root with one child is only a level of indirection.
+
+        while (!root->leaf && root->count == 1)
+        {
+            Inner *top = static_cast<Inner *>(root);
+            root = top->children[0];
+            root->parent = nullptr;
+            inners.destroy(top);
+            --levels;
+        }
+    }
+
+    Node *spineNode(bool rightmost, int height) const
+    { // The first or last node on the level that is height levels above the bottom (leaves are 1).
+
+        Node *node = root;
+        for (int level = levels; level > height; --level)
+        {
+            Inner *inner = static_cast<Inner *>(node);
+            node = inner->children[rightmost ? inner->count - 1 : 0];
+        }
+        return node;
+    }
+
+    template <typename Dispose>
+    void destroy(Node *node, Dispose &dispose)
+    {
+        if (node->leaf)
+        {
+            Leaf *leaf = static_cast<Leaf *>(node);
+            for (int i = 0; i < leaf->count; ++i)
+                dispose(leaf->values[i]);
+            leaves.destroy(leaf);
+            return;
+        }
+        Inner *inner = static_cast<Inner *>(node);
+        for (int i = 0; i < inner->count; ++i)
+            destroy(inner->children[i], dispose);
+        inners.destroy(inner);
+    }
+
+public:
+    BPlusTree() = default;
+    BPlusTree(const BPlusTree &) = delete;
+    BPlusTree &operator=(const BPlusTree &) = delete;
+
+    ~BPlusTree() { clear(); }
+
+    int size() const { return total; }
+    bool empty() const { return total == 0; }
+    const TreeCounters &counters() const { return stats; }
+
+    TreeShape shape() const
+    {
+        TreeShape shape;
+        shape.entries = static_cast<std::uint64_t>(total);
+        shape.nodes = leaves.size() + inners.size();
+        shape.height = levels;
+        return shape;
+    }
+
+    Cursor first() const { return head && head->count ? Cursor(head, 0) : Cursor(); }
+    Cursor last() const { return tail && tail->count ? Cursor(tail, tail->count - 1) : Cursor(); }
+
+    Cursor lowerBound(int key) const
+    { // First entry whose key is at least key.
+
+        if (root == nullptr)
+            return Cursor();
+        const Node *node = root;
+        while (!node->leaf)
+        {
+            const Inner *inner = static_cast<const Inner *>(node);
+            node = inner->children[countLess(inner->keys, inner->count - 1, key)];
+        }
+        Leaf *leaf = const_cast<Leaf *>(static_cast<const Leaf *>(node));
+        int slot = countLess(leaf->keys, leaf->count, key);
+        if (slot == leaf->count)
+            return leaf->next ? Cursor(leaf->next, 0) : Cursor();
+        return Cursor(leaf, slot);
+    }
+
+    Cursor upperBound(int key) const
+    { // First entry whose key is greater than key.
+
+        if (root == nullptr)
+            return Cursor();
+        const Node *node = root;
+        while (!node->leaf)
+        {
+            const Inner *inner = static_cast<const Inner *>(node);
+            node = inner->children[countLessEqual(inner->keys, inner->count - 1, key)];
+        }
+        Leaf *leaf = const_cast<Leaf *>(static_cast<const Leaf *>(node));
+        int slot = countLessEqual(leaf->keys, leaf->count, key);
+        if (slot == leaf->count)
+            return leaf->next ? Cursor(leaf->next, 0) : Cursor();
+        return Cursor(leaf, slot);
+    }
+
+    Cursor find(int key) const
+    {
+        stats.recordFind(static_cast<std::uint64_t>(levels));
+        Cursor found = lowerBound(key);
+        return found.valid() && found.key() == key ? found : Cursor();
+    }
+
+    Cursor find(Leaf *&finger, int key) const
+    { // find() for a nondecreasing run of keys: stays in the previous leaf while it must hold the key.
+
+        if (finger != nullptr && finger->count > 0 && finger->keys[0] < key && key <= finger->keys[finger->count - 1])
+        {
+            int slot = countLess(finger->keys, finger->count, key);
+            stats.recordFind(1);
+            return finger->keys[slot] == key ? Cursor(finger, slot) : Cursor();
+        }
+        stats.recordFind(static_cast<std::uint64_t>(levels));
+        Cursor found = lowerBound(key);
+        finger = found.leaf();
+        return found.valid() && found.key() == key ? found : Cursor();
+    }
+
+    int countBelow(int key, bool inclusive) const
+    { // Entries with a key below key (or at most key when inclusive).
+
+        int below = 0;
+        const Node *node = root;
+        while (node != nullptr && !node->leaf)
+        {
+            const Inner *inner = static_cast<const Inner *>(node);
+            int child = inclusive ? countLessEqual(inner->keys, inner->count - 1, key) : countLess(inner->keys, inner->count - 1, key);
+            below += sum(inner->sizes, child);
+            node = inner->children[child];
+        }
+        if (node != nullptr)
+        {
+            const Leaf *leaf = static_cast<const Leaf *>(node);
+            below += inclusive ? countLessEqual(leaf->keys, leaf->count, key) : countLess(leaf->keys, leaf->count, key);
+        }
+        return below;
+    }
+
+    Cursor select(int rank) const
+    { // The rank-th entry in key order (1-based).
+
+        if (rank < 1 || rank > total)
+            return Cursor();
+        const Node *node = root;
+        while (!node->leaf)
+        {
+            const Inner *inner = static_cast<const Inner *>(node);
+            int child = 0;
+            while (rank > inner->sizes[child])
+                rank -= inner->sizes[child++];
+            node = inner->children[child];
+        }
+        return Cursor(const_cast<Leaf *>(static_cast<const Leaf *>(node)), rank - 1);
+    }
+
+    void insert(int key, Value value)
+    { // Adds an entry after any with an equal key.
+
+        if (root == nullptr)
+        {
+            head = tail = leaves.create();
+            root = head;
+            levels = 1;
+        }
+        Node *node = root;
+        while (!node->leaf)
+        {
+            Inner *inner = static_cast<Inner *>(node);
+            int child = countLessEqual(inner->keys, inner->count - 1, key);
+            ++inner->sizes[child];
+            node = inner->children[child];
+        }
+        Leaf *leaf = static_cast<Leaf *>(node);
+        int slot = countLessEqual(leaf->keys, leaf->count, key);
+        if (leaf->count == kSlots)
+        {
+            adjustSizes(leaf, -1); // The split recounts from the leaves; undo the descent's increments.
+            Leaf *right = splitLeaf(leaf);
+            if (slot > leaf->count)
+            {
+                slot -= leaf->count;
+                leaf = right;
+            }
+            adjustSizes(leaf, 1);
+        }
+        for (int i = leaf->count; i > slot; --i)
+        {
+            leaf->keys[i] = leaf->keys[i - 1];
+            leaf->values[i] = leaf->values[i - 1];
+        }
+        leaf->keys[slot] = key;
+        leaf->values[slot] = value;
+        ++leaf->count;
+        ++total;
+    }
+
+    void erase(Cursor at)
+    { // Removes the entry at the cursor; the value is the caller's to dispose of first.
+
+        Leaf *leaf = at.leaf();
+        for (int i = at.slot(); i < leaf->count - 1; ++i)
+        {
+            leaf->keys[i] = leaf->keys[i + 1];
+            leaf->values[i] = leaf->values[i + 1];
+        }
+        leaf->keys[--leaf->count] = INT_MAX;
+        if (--total == 0)
+        {
+            clear();
+            return;
+        }
+        adjustSizes(leaf, -1);
+        restore(leaf);
+        collapseRoot();
+    }
+
+    template <typename Dispose>
+    void eraseRange(int low, int high, Dispose dispose)
+    { // Removes every entry with a key in [low, high] and calls dispose(value) on each in key order.
+      // Whole leaves go at once, with one walk up per leaf, and the two edges of the range are
+      // mended after: O(log n + k) for k entries.
+
+        Cursor at = lowerBound(low);
+        Leaf *leaf = at.leaf();
+        int from = at.slot();
+        while (leaf != nullptr && from < leaf->count && leaf->keys[from] <= high)
+        {
+            int to = countLessEqual(leaf->keys, leaf->count, high);
+            for (int i = from; i < to; ++i)
+                dispose(leaf->values[i]);
+            int removed = to - from;
+            Leaf *next = to == leaf->count ? leaf->next : nullptr; // The range may go on in the next leaf.
+            for (int i = to; i < leaf->count; ++i)
+            {
+                leaf->keys[i - removed] = leaf->keys[i];
+                leaf->values[i - removed] = leaf->values[i];
+            }
+            std::fill(leaf->keys + leaf->count - removed, leaf->keys + leaf->count, INT_MAX);
+            leaf->count -= removed;
+            total -= removed;
+            if (total == 0)
+            {
+                clear();
+                return;
+            }
+            adjustSizes(leaf, -removed);
+            if (leaf->count == 0)
+                dropLeaf(leaf);
+            leaf = next;
+            from = 0;
+        }
+        if (root == nullptr)
+            return;
+        collapseRoot();
+        // Nodes that lost entries but not all of them lie above the entries on either side of the
+        // range. Each side is found again after the other is mended, since merges move entries.
+        for (bool above : {true, false})
+        {
+            Cursor side = lowerBound(low);
+            if (!above)
+                side = side.valid() ? side.prev() : last();
+            if (side.valid())
+            {
+                restore(side.leaf());
+                collapseRoot();
+            }
+        }
+    }
+
+    void join(BPlusTree &other)
+    { // Moves every entry of other into this tree, leaving other empty. All of other's keys must sort
+      // after all of this tree's, or all before them. The shorter tree's root becomes a child on the
+      // taller one's outer spine, at its own height, splitting full nodes above it as an insert
+      // would, and is mended if it is short: O(log n). This tree's pools take over other's nodes.
+
+        Node *hung = nullptr; // The shorter tree's root, now a child on the taller one's spine.
+        if (root == nullptr)
+        {
+            root = other.root;
+            head = other.head;
+            tail = other.tail;
+            total = other.total;
+            levels = other.levels;
+        }
+        else if (other.root != nullptr)
+        {
+            bool after = other.head->keys[0] >= tail->keys[tail->count - 1];
+            BPlusTree &taller = levels >= other.levels ? *this : other;
+            BPlusTree &shorter = levels >= other.levels ? other : *this;
+            bool hangRight = (&taller == this) == after; // The shorter tree goes after the taller one.
+            Node *anchor = taller.spineNode(hangRight, shorter.levels);
+            hung = shorter.root;
+            Leaf *lowerTail = after ? tail : other.tail;
+            Leaf *upperHead = after ? other.head : head;
+            taller.linkSibling(anchor, upperHead->keys[0], hung);
+            if (!hangRight)
+            { // linkSibling put hung after anchor, its leftmost sibling; swap the two.
+                Inner *parent = anchor->parent;
+                std::swap(parent->children[0], parent->children[1]);
+                std::swap(parent->sizes[0], parent->sizes[1]);
+            }
+            taller.adjustSizes(hung->parent, shorter.total);
+            lowerTail->next = upperHead;
+            upperHead->prev = lowerTail;
+            Leaf *first = after ? head : other.head;
+            Leaf *last = after ? other.tail : tail;
+            root = taller.root;
+            levels = taller.levels;
+            total += other.total;
+            head = first;
+            tail = last;
+        }
+        other.root = nullptr;
+        other.head = other.tail = nullptr;
+        other.total = 0;
+        other.levels = 0;
+        leaves.adopt(other.leaves); // A split in other may have made a node, and mending may free one.
+        inners.adopt(other.inners);
+        if (hung != nullptr)
+        {
+            restore(hung);
+            collapseRoot();
+        }
+    }
+
+    void buildFromSorted(const std::vector<int> &keys, const std::vector<Value> &values)
+    { // Builds the tree bottom-up from entries in key order, with full nodes. The tree must be empty.
+
+        std::vector<Node *> level;
+        for (std::size_t i = 0; i < keys.size(); i += kSlots)
+        {
+            Leaf *leaf = leaves.create();
+            leaf->count = static_cast<int>(std::min<std::size_t>(kSlots, keys.size() - i));
+            for (int j = 0; j < leaf->count; ++j)
+            {
+                leaf->keys[j] = keys[i + j];
+                leaf->values[j] = values[i + j];
+            }
+            leaf->prev = tail;
+            (tail ? tail->next : head) = leaf;
+            tail = leaf;
+            level.push_back(leaf);
+        }
+        levels = level.empty() ? 0 : 1;
+        std::vector<int> lowest(level.size()); // Smallest key under each node of the level.
+        for (std::size_t i = 0; i < level.size(); ++i)
+            lowest[i] = static_cast<Leaf *>(level[i])->keys[0];
+        while (level.size() > 1)
+        {
+            std::vector<Node *> above;
+            std::vector<int> aboveLowest;
+            for (std::size_t i = 0; i < level.size(); i += kSlots)
+            {
+                Inner *inner = inners.create();
+                inner->count = static_cast<int>(std::min<std::size_t>(kSlots, level.size() - i));
+                for (int j = 0; j < inner->count; ++j)
+                {
+                    inner->children[j] = level[i + j];
+                    inner->sizes[j] = sizeOf(level[i + j]);
+                    level[i + j]->parent = inner;
+                    if (j > 0)
+                        inner->keys[j - 1] = lowest[i + j];
+                }
+                above.push_back(inner);
+                aboveLowest.push_back(lowest[i]);
+            }
+            level.swap(above);
+            lowest.swap(aboveLowest);
+            ++levels;
+        }
+        root = level.empty() ? nullptr : level.front();
+        total = static_cast<int>(keys.size());
+        if (root != nullptr)
+        { // Only the last node of each level can be short.
+            restore(tail);
+            collapseRoot();
+        }
+    }
+
+    template <typename Dispose>
+    void clear(Dispose dispose)
+    { // Calls dispose(value) for every entry, then frees every node.
+
+        if (root != nullptr)
+            destroy(root, dispose);
+        root = nullptr;
+        head = tail = nullptr;
+        total = 0;
+        levels = 0;
+    }
+
+    void clear()
+    {
+        clear([](Value &) {});
+    }
+};
+
+#endif
@@ -0,0 +1,365 @@
+#ifndef COMMAND_PARSER_H
+#define COMMAND_PARSER_H
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+#include <charconv>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+enum class CommandType
+{
+    Unknown,
+    InsertBook,
+    PrintBook,
+    PrintBooks,
+    BorrowBook,
+    ReturnBook,
+    FindClosestBook,
+    DeleteBook,
+    DeleteRange,
+    ColorFlipCount,
+    CountBooks,
+    SelectBook,
+    RankOf,
+    CancelReservation,
+    UpdatePriority,
+    PrintPatron,
+    ReturnAll,
+    FindByAuthor,
+    FindByTitlePrefix,
+    SaveSnapshot,
+    LoadSnapshot,
+    Stats,
+    Quit
+};
+
+// One input line. Fields are views into the parser's buffer with quotes
+// already removed; they stay valid for the lifetime of the parser, or for as
+// long as its keepAlive() handle is held. Bit i of `parsed` says values[i]
+// already holds fields[i] as an integer, so integer(i) need not convert it.
+struct Command
+{
+    CommandType type = CommandType::Unknown;
+    int fieldCount = 0;
+    std::string_view fields[4];
+    int values[4];
+    unsigned parsed = 0;
+
+    int integer(int i) const;
+};
+
+inline std::errc scanInteger(std::string_view text, int &value)
+{ // parseInteger without the exceptions: returns the error it would throw for, or errc() with value set.
+
+    const char *first = text.data();
+    const char *last = first + text.size();
+    while (first != last && (*first == ' ' || (*first >= '\t' && *first <= '\r')))
+        ++first;
+    bool negative = false;
+    if (first != last && (*first == '+' || *first == '-'))
+    {
+        negative = *first == '-';
+        ++first;
+    }
+    long long wide = 0;
+    auto [end, error] = std::from_chars(first, last, wide);
+    if (error == std::errc::invalid_argument || (first != last && *first == '-'))
+        return std::errc::invalid_argument;
+    if (negative)
+        wide = -wide;
+    if (error == std::errc::result_out_of_range || wide < std::numeric_limits<int>::min() || wide > std::numeric_limits<int>::max())
+        return std::errc::result_out_of_range;
+    value = static_cast<int>(wide);
+    return std::errc();
+}
+
+inline int parseInteger(std::string_view text)
+{ // Converts like std::stoi: leading whitespace and a sign are accepted, trailing junk is ignored.
+
+    int value = 0;
+    std::errc error = scanInteger(text, value);
+    if (error == std::errc::invalid_argument)
+        throw std::invalid_argument("stoi");
+    if (error == std::errc::result_out_of_range)
+        throw std::out_of_range("stoi");
+    return value;
+}
+
+inline int Command::integer(int i) const { return (parsed >> i & 1) ? values[i] : parseInteger(fields[i]); }
+
+// Reads commands straight out of a memory-mapped input file. Lines are
+// tokenized in place, so no memory is allocated per line.
+//
+// The tokenizing reproduces the original getline/stringstream loop exactly:
+// every '"' is dropped, the last character of the line stands in for a ',',
+// the command name runs up to '(', and each further field runs up to the next
+// ',' after skipping one character.
+class CommandParser
+{
+private:
+    struct InputBuffer
+    { // The input's bytes. Shared, so whoever keeps views into the text can keep it alive.
+        char *data = nullptr;
+        std::size_t size = 0;
+        bool mapped = false;
+        std::vector<char> fallback; // Used when the input cannot be mapped (pipes and the like).
+
+        InputBuffer() = default;
+        InputBuffer(const InputBuffer &) = delete;
+        InputBuffer &operator=(const InputBuffer &) = delete;
+
+        ~InputBuffer()
+        {
+            if (mapped)
+                ::munmap(data, size);
+        }
+    };
+
+    std::shared_ptr<InputBuffer> input = std::make_shared<InputBuffer>();
+    char *data = nullptr;
+    std::size_t size = 0;
+    std::size_t offset = 0;
+    bool opened = false;
+
+    static CommandType classify(std::string_view name)
+    {
+        if (name == "InsertBook")
+            return CommandType::InsertBook;
+        if (name == "PrintBook")
+            return CommandType::PrintBook;
+        if (name == "PrintBooks")
+            return CommandType::PrintBooks;
+        if (name == "BorrowBook")
+            return CommandType::BorrowBook;
+        if (name == "ReturnBook")
+            return CommandType::ReturnBook;
+        if (name == "FindClosestBook")
+            return CommandType::FindClosestBook;
+        if (name == "DeleteBook")
+            return CommandType::DeleteBook;
+        if (name == "DeleteRange")
+            return CommandType::DeleteRange;
+        if (name == "ColorFlipCount")
+            return CommandType::ColorFlipCount;
+        if (name == "CountBooks")
+            return CommandType::CountBooks;
+        if (name == "SelectBook")
+            return CommandType::SelectBook;
+        if (name == "RankOf")
+            return CommandType::RankOf;
+        if (name == "CancelReservation")
+            return CommandType::CancelReservation;
+        if (name == "UpdatePriority")
+            return CommandType::UpdatePriority;
+        if (name == "PrintPatron")
+            return CommandType::PrintPatron;
+        if (name == "ReturnAll")
+            return CommandType::ReturnAll;
+        if (name == "FindByAuthor")
+            return CommandType::FindByAuthor;
+        if (name == "FindByTitlePrefix")
+            return CommandType::FindByTitlePrefix;
+        if (name == "SaveSnapshot")
+            return CommandType::SaveSnapshot;
+        if (name == "LoadSnapshot")
+            return CommandType::LoadSnapshot;
+        if (name == "Stats")
+            return CommandType::Stats;
+        if (name == "Quit")
+            return CommandType::Quit;
+        return CommandType::Unknown;
+    }
+
+    static int fieldsOf(CommandType type)
+    {
+        switch (type)
+        {
+        case CommandType::InsertBook:
+            return 4;
+        case CommandType::BorrowBook:
+        case CommandType::UpdatePriority:
+            return 3;
+        case CommandType::PrintBooks:
+        case CommandType::DeleteRange:
+        case CommandType::ReturnBook:
+        case CommandType::CancelReservation:
+        case CommandType::CountBooks:
+            return 2;
+        case CommandType::PrintBook:
+        case CommandType::FindClosestBook:
+        case CommandType::DeleteBook:
+        case CommandType::SelectBook:
+        case CommandType::RankOf:
+        case CommandType::PrintPatron:
+        case CommandType::ReturnAll:
+        case CommandType::FindByAuthor:
+        case CommandType::FindByTitlePrefix:
+        case CommandType::SaveSnapshot:
+        case CommandType::LoadSnapshot:
+            return 1;
+        default:
+            return 0;
+        }
+    }
+
+    // Cursor over one line as the old loop saw it: quotes are skipped and the
+    // character at `last` reads as ','.
+    struct LineCursor
+    {
+        char *pos;
+        char *last;
+
+        void skipQuotes()
+        {
+            while (pos < last && *pos == '"')
+                ++pos;
+        }
+
+        void ignore()
+        { // istream::ignore(): drops one character.
+
+            skipQuotes();
+            if (pos <= last)
+                ++pos;
+        }
+
+        bool field(char delimiter, std::string_view &out)
+        { // getline(stream, out, delimiter). Returns false when the delimiter never showed up.
+
+            skipQuotes();
+            if (pos > last)
+            {
+                out = {};
+                return false;
+            }
+            char *start = pos;
+            char *stop = pos;
+            while (stop < last && *stop != delimiter)
+                ++stop;
+            pos = stop + 1;
+            out = squeeze(start, stop);
+            return stop < last || delimiter == ',';
+        }
+
+        static std::string_view squeeze(char *start, char *stop)
+        { // Trailing quotes are trimmed; only a quote inside the field forces an in-place rewrite.
+
+            while (stop > start && stop[-1] == '"')
+                --stop;
+            if (std::find(start, stop, '"') != stop)
+            {
+                char *out = start;
+                for (char *in = start; in < stop; ++in)
+                    if (*in != '"')
+                        *out++ = *in;
+                stop = out;
+            }
+            return std::string_view(start, stop - start);
+        }
+    };
+
+public:
+    explicit CommandParser(const std::string &filename)
+    {
+        int fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd < 0)
+            return;
+        opened = true;
+
+        struct stat info;
+        if (::fstat(fd, &info) == 0 && S_ISREG(info.st_mode))
+        {
+            size = static_cast<std::size_t>(info.st_size);
+            if (size == 0)
+            {
+                ::close(fd);
+                return;
+            }
+            // Private and writable so the rare quote inside a field can be squeezed out in place.
+            void *map = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+            if (map != MAP_FAILED)
+            {
+                ::madvise(map, size, MADV_SEQUENTIAL);
+                data = input->data = static_cast<char *>(map);
+                input->size = size;
+                input->mapped = true;
+                ::close(fd);
+                return;
+            }
+        }
+
+        char chunk[1 << 16];
+        ssize_t got;
+        std::vector<char> &fallback = input->fallback;
+        while ((got = ::read(fd, chunk, sizeof(chunk))) > 0 || (got < 0 && errno == EINTR))
+            if (got > 0)
+                fallback.insert(fallback.end(), chunk, chunk + got);
+        ::close(fd);
+        data = input->data = fallback.data();
+        size = input->size = fallback.size();
+    }
+
+    CommandParser(const CommandParser &) = delete;
+    CommandParser &operator=(const CommandParser &) = delete;
+
+    bool isOpen() const { return opened; }
+
+    // The whole input, and a handle that keeps it alive past the parser. Field
+    // views only change while their own line is being parsed, so text that has
+    // already been handed out can be referenced instead of copied.
+    std::string_view text() const { return std::string_view(data, size); }
+    std::shared_ptr<const void> keepAlive() const { return input; }
+
+    bool next(Command &command)
+    { // Parses the next line into `command`; returns false at the end of the input.
+
+        while (offset < size)
+        {
+            char *line = data + offset;
+            char *newline = static_cast<char *>(std::memchr(line, '\n', size - offset));
+            char *lineEnd = newline ? newline : data + size;
+            offset = (lineEnd - data) + (newline ? 1 : 0);
+            if (parseLine(line, lineEnd, command))
+                return true;
+        }
+        return false;
+    }
+
+    static bool parseLine(char *line, char *lineEnd, Command &command)
+    { // Tokenizes [line, lineEnd), which holds no '\n', in place. Returns false for a line that is no command.
+
+        char *last = lineEnd; // The last non-quote character becomes the ','.
+        while (last > line && last[-1] == '"')
+            --last;
+        if (last == line)
+            return false; // Nothing but quotes (or an empty line): no command.
+        --last;
+
+        LineCursor cursor{line, last};
+        std::string_view name;
+        command.type = cursor.field('(', name) ? classify(name) : CommandType::Unknown;
+        command.fieldCount = fieldsOf(command.type);
+        command.parsed = 0;
+        for (int i = 0; i < command.fieldCount; ++i)
+        {
+            if (i > 0)
+                cursor.ignore();
+            cursor.field(',', command.fields[i]);
+        }
+        return true;
+    }
+};
+
+#endif
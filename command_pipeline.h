@@ -0,0 +1,350 @@
+#ifndef COMMAND_PIPELINE_H
+#define COMMAND_PIPELINE_H
+
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include "command_parser.h"
+#include "output_sink.h"
+#include "spsc_ring.h"
+
+// Reads, parses and applies a command log as a pipeline, so the stages
+// overlap instead of adding up:
+//
+//   reader    one thread; read()s the input into blocks of whole lines
+//   parsers   N threads; tokenize blocks into compact CommandRecords
+//   apply     the thread that calls run(); executes the records in order
+//
+// Blocks go round-robin: block k is parsed by parser k % N, and the apply
+// thread collects them in the same rotation, so commands come out in input
+// order without any reordering buffer. Every hand-off is an SpscRing, one
+// per parser in each direction plus one returning applied blocks to the
+// reader. A fixed set of blocks circulates, so memory stays bounded however
+// long the log is, and pipes work as well as files.
+//
+// Fields handed to the apply function point into the block, which is reused
+// once the block has been applied: anything kept longer must be copied.
+class CommandPipeline
+{
+public:
+    static constexpr std::size_t kBlockSize = 1 << 20;
+
+private:
+    struct CommandRecord
+    { // One parsed line: field offsets into its block, and the fields that read as integers.
+        std::uint32_t offsets[4];
+        std::uint32_t lengths[4];
+        std::int32_t values[4];
+        CommandType type;
+        std::uint8_t fieldCount;
+        std::uint8_t parsed;
+    };
+
+    struct Block
+    {
+        std::unique_ptr<char[]> text;
+        std::size_t capacity;
+        std::size_t size = 0;
+        std::vector<CommandRecord> records;
+
+        explicit Block(std::size_t capacity) : text(new char[capacity]), capacity(capacity) {}
+    };
+
+    struct Parser
+    {
+        SpscRing<Block *> unparsed; // From the reader.
+        SpscRing<Block *> parsed;   // To the apply thread.
+
+        explicit Parser(std::size_t capacity) : unparsed(capacity), parsed(capacity) {}
+    };
+
+    int fd;
+    std::size_t blockSize;
+    std::vector<std::unique_ptr<Block>> blocks;
+    std::vector<std::unique_ptr<Parser>> parsers;
+    SpscRing<Block *> spare; // Applied blocks, back to the reader.
+    std::atomic<bool> stopping{false};
+
+    template <typename Item>
+    bool pop(SpscRing<Item> &ring, Item &item)
+    { // Waits for an item; false if the pipeline is stopping first.
+
+        Backoff backoff;
+        while (!ring.tryPop(item))
+        {
+            if (stopping.load(std::memory_order_acquire))
+                return false;
+            backoff.pause();
+        }
+        return true;
+    }
+
+    static void push(SpscRing<Block *> &ring, Block *block)
+    { // Every ring holds all the blocks, so this never has to wait.
+
+        ring.tryPush(block);
+    }
+
+    std::size_t fill(Block &block, std::size_t from)
+    { // Reads until the block is full or the input ends. Returns the bytes now in it.
+
+        while (from < block.capacity)
+        {
+            ssize_t got = ::read(fd, block.text.get() + from, block.capacity - from);
+            if (got < 0 && errno == EINTR)
+                continue;
+            if (got <= 0)
+                break;
+            from += static_cast<std::size_t>(got);
+        }
+        return from;
+    }
+
+    void read()
+    { // The reader: whole lines into each block, the partial last line carried into the next one.
+
+        std::vector<char> carry;
+        bool ended = false;
+        for (std::size_t sequence = 0; !ended; ++sequence)
+        {
+            Block *block;
+            if (!pop(spare, block))
+                return;
+            if (block->capacity < carry.size() + blockSize / 2)
+                *block = Block(carry.size() + blockSize);
+            if (!carry.empty())
+                std::memcpy(block->text.get(), carry.data(), carry.size());
+            std::size_t filled = fill(*block, carry.size());
+            char *newline = nullptr;
+            while (filled == block->capacity && !(newline = static_cast<char *>(::memrchr(block->text.get(), '\n', filled))))
+            { // One line longer than the block: grow it until the line ends.
+
+                Block larger(block->capacity * 2);
+                std::memcpy(larger.text.get(), block->text.get(), filled);
+                *block = std::move(larger);
+                filled = fill(*block, filled);
+            }
+            ended = filled < block->capacity;
+            block->size = ended ? filled : static_cast<std::size_t>(newline + 1 - block->text.get());
+            carry.assign(block->text.get() + block->size, block->text.get() + filled);
+            push(parsers[sequence % parsers.size()]->unparsed, block);
+        }
+        for (std::unique_ptr<Parser> &parser : parsers)
+            push(parser->unparsed, nullptr); // The end, wherever the rotation is.
+    }
+
+    static void tokenize(Block &block)
+    {
+        block.records.clear();
+        char *text = block.text.get();
+        char *end = text + block.size;
+        Command command;
+        for (char *line = text; line < end;)
+        {
+            char *newline = static_cast<char *>(std::memchr(line, '\n', end - line));
+            char *lineEnd = newline ? newline : end;
+            if (CommandParser::parseLine(line, lineEnd, command))
+            {
+                CommandRecord record;
+                record.type = command.type;
+                record.fieldCount = static_cast<std::uint8_t>(command.fieldCount);
+                record.parsed = 0;
+                for (int i = 0; i < command.fieldCount; ++i)
+                {
+                    std::string_view field = command.fields[i];
+                    record.offsets[i] = field.data() ? static_cast<std::uint32_t>(field.data() - text) : 0;
+                    record.lengths[i] = static_cast<std::uint32_t>(field.size());
+                    record.values[i] = 0;
+                    if (scanInteger(field, record.values[i]) == std::errc())
+                        record.parsed |= 1 << i;
+                }
+                block.records.push_back(record);
+            }
+            line = newline ? newline + 1 : end;
+        }
+    }
+
+    void parse(Parser &parser)
+    {
+        Block *block;
+        while (pop(parser.unparsed, block))
+        {
+            if (block)
+                tokenize(*block);
+            push(parser.parsed, block);
+            if (!block)
+                return;
+        }
+    }
+
+public:
+    CommandPipeline(const std::string &filename, int parserCount, std::size_t blockSize = kBlockSize)
+        : fd(::open(filename.c_str(), O_RDONLY)), blockSize(blockSize), spare(2 * parserCount + 2)
+    {
+        std::size_t count = 2 * parserCount + 2; // Two per parser, so each has the next block waiting, plus the reader's and the apply thread's.
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            blocks.push_back(std::make_unique<Block>(blockSize));
+            Block *block = blocks.back().get();
+            push(spare, block);
+        }
+        for (int i = 0; i < parserCount; ++i)
+            parsers.push_back(std::make_unique<Parser>(count + 1)); // Room for the end marker too.
+        if (fd >= 0)
+            ::posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    }
+
+    CommandPipeline(const CommandPipeline &) = delete;
+    CommandPipeline &operator=(const CommandPipeline &) = delete;
+
+    ~CommandPipeline()
+    {
+        if (fd >= 0)
+            ::close(fd);
+    }
+
+    bool isOpen() const { return fd >= 0; }
+
+    template <typename Apply>
+    void run(Apply apply)
+    { // Calls apply(command) for each command in input order until it returns false or the input ends.
+
+        std::vector<std::thread> threads;
+        struct Joiner
+        { // Stops and joins the stages however run() is left.
+            CommandPipeline &pipeline;
+            std::vector<std::thread> &threads;
+            ~Joiner()
+            {
+                pipeline.stopping.store(true, std::memory_order_release);
+                for (std::thread &thread : threads)
+                    thread.join();
+            }
+        } joiner{*this, threads};
+
+        threads.emplace_back([this]
+                             { read(); });
+        for (std::unique_ptr<Parser> &parser : parsers)
+            threads.emplace_back([this, &parser]
+                                 { parse(*parser); });
+
+        Command command;
+        for (std::size_t sequence = 0;; ++sequence)
+        {
+            Block *block;
+            if (!pop(parsers[sequence % parsers.size()]->parsed, block) || !block)
+                return;
+            const char *text = block->text.get();
+            for (const CommandRecord &record : block->records)
+            {
+                command.type = record.type;
+                command.fieldCount = record.fieldCount;
+                command.parsed = record.parsed;
+                for (int i = 0; i < record.fieldCount; ++i)
+                {
+                    command.fields[i] = std::string_view(text + record.offsets[i], record.lengths[i]);
+                    command.values[i] = record.values[i];
+                }
+                if (!apply(command))
+                    return;
+            }
+            push(spare, block);
+        }
+    }
+};
+
+// The writer stage: sinks attached here hand their full buffers to a thread
+// that writes them out, in the order they were handed over, while the sink
+// carries on in a fresh buffer. Every attached sink must be written from the
+// same one thread. finish() (or the destructor) flushes the sinks, waits for
+// the last write and gives the sinks back their own writing.
+class BackgroundWriter final : public SinkDrain
+{
+private:
+    static constexpr std::size_t kInFlight = 8; // Buffers written ahead of the sinks at most.
+
+    struct Pending
+    {
+        int fd = -1;
+        std::unique_ptr<char[]> buffer;
+        std::size_t size = 0;
+        std::size_t capacity = 0;
+    };
+
+    SpscRing<Pending> pending{kInFlight};
+    SpscRing<Pending> written{kInFlight}; // Empty buffers coming back.
+    std::vector<OutputSink *> sinks;
+    std::atomic<bool> closing{false};
+    std::thread thread;
+
+    void write()
+    {
+        Backoff backoff;
+        for (;;)
+        {
+            bool last = closing.load(std::memory_order_acquire); // Read before the ring, so no buffer pushed earlier is missed.
+            Pending item;
+            if (!pending.tryPop(item))
+            {
+                if (last)
+                    return;
+                backoff.pause();
+                continue;
+            }
+            backoff.reset();
+            writeFully(item.fd, item.buffer.get(), item.size);
+            written.tryPush(item); // Dropped when the sinks have plenty spare already.
+        }
+    }
+
+public:
+    BackgroundWriter() = default;
+    BackgroundWriter(const BackgroundWriter &) = delete;
+    BackgroundWriter &operator=(const BackgroundWriter &) = delete;
+
+    ~BackgroundWriter() { finish(); }
+
+    void attach(OutputSink &sink)
+    {
+        if (!thread.joinable())
+            thread = std::thread([this]
+                                 { write(); });
+        sink.drainThrough(this);
+        sinks.push_back(&sink);
+    }
+
+    void finish()
+    {
+        if (!thread.joinable())
+            return;
+        for (OutputSink *sink : sinks)
+            sink->drainThrough(nullptr);
+        sinks.clear();
+        closing.store(true, std::memory_order_release);
+        thread.join();
+        closing.store(false, std::memory_order_relaxed);
+    }
+
+    std::unique_ptr<char[]> exchange(int fd, std::unique_ptr<char[]> full, std::size_t size, std::size_t capacity) override
+    {
+        Pending item{fd, std::move(full), size, capacity};
+        Backoff backoff;
+        while (!pending.tryPush(item))
+            backoff.pause(); // The writer is kInFlight buffers behind; let it catch up.
+        Pending empty;
+        if (written.tryPop(empty) && empty.capacity >= capacity)
+            return std::move(empty.buffer);
+        return std::unique_ptr<char[]>(new char[capacity]);
+    }
+};
+
+#endif
@@ -0,0 +1,2040 @@
+#ifndef GATOR_LIBRARY_H
+#define GATOR_LIBRARY_H
+
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <ctime>
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <mutex>
+#include <memory>
+#include <set>
+#include <shared_mutex>
+#include <unordered_map>
+#include "bplus_tree.h"
+#include "output_sink.h"
+#include "persistent_rb_tree.h"
+#include "query_cache.h"
+#include "rb_tree.h"
+#include "reservation_heap.h"
+#include "slab_pool.h"
+#include "snapshot.h"
+#include "stats.h"
+#include "string_arena.h"
+#include "write_ahead_log.h"
+
+// The names are views into storage owned by the library: its string arena,
+// its author interner, or input text it has adopted.
+struct Book
+{
+    int bookID;
+    std::string_view bookName;
+    std::string_view authorName;
+    bool availabilityStatus;
+    int borrowedBy;
+    ReservationHeap reservationHeap;
+
+    Book(int id, std::string_view name, std::string_view author, bool available)
+        : bookID(id), bookName(name), authorName(author), availabilityStatus(available), borrowedBy(-1)
+    {
+    }
+
+    void addReservation(int patronID, int patronPriority, std::uint64_t sequence, time_t timestamp)
+    {
+        reservationHeap.push(patronID, patronPriority, sequence, timestamp);
+    }
+
+    void removeReservation()
+    {
+        if (!reservationHeap.empty())
+        {
+            reservationHeap.pop();
+        }
+    }
+};
+
+// A book as it stood in one version of a library's catalog (see
+// CatalogVersion). The names point into the library's storage.
+struct BookImage
+{
+    int bookID;
+    std::string_view bookName;
+    std::string_view authorName;
+    bool availabilityStatus;
+    int borrowedBy;
+    std::vector<int> reservations; // Waiting patrons in service order.
+};
+
+inline void printWaitingPatrons(const Book &book, OutputSink &output)
+{ // Waiting patrons in service order, comma separated.
+
+    const char *separator = "";
+    book.reservationHeap.forEachInOrder([&](const ReservationNode &reservation)
+                                        {
+        output << separator << reservation.patronID;
+        separator = ", "; });
+}
+
+inline void printWaitingPatrons(const BookImage &book, OutputSink &output)
+{
+    for (std::size_t i = 0; i < book.reservations.size(); ++i)
+        output << (i ? ", " : "") << book.reservations[i];
+}
+
+template <typename AnyBook>
+void printBookBlock(const AnyBook &book, OutputSink &output)
+{ // The PrintBook block, for a live Book or a BookImage.
+
+    output << "\nBookID = " << book.bookID << '\n';
+    output << "Title = "
+           << "\"" << book.bookName << "\"" << '\n';
+    output << "Author = "
+           << "\"" << book.authorName << "\"" << '\n';
+    output << "Availability = \"" << (book.availabilityStatus ? "Yes\"" : "No\"") << '\n';
+    output << "BorrowedBy = ";
+    if (book.borrowedBy == -1)
+        output << "None";
+    else
+        output << book.borrowedBy;
+    output << '\n';
+
+    output << "Reservations = [";
+    printWaitingPatrons(book, output);
+    output << "]\n"
+           << '\n';
+}
+
+// Orders books by one of their name fields, then by bookID. Lookups can use
+// a bare string_view, so an exact name or a prefix is found with lower_bound.
+template <std::string_view Book::*Field>
+struct ByName
+{
+    using is_transparent = void;
+
+    bool operator()(const Book *a, const Book *b) const
+    {
+        int order = (a->*Field).compare(b->*Field);
+        if (order != 0)
+            return order < 0;
+        return a->bookID != b->bookID ? a->bookID < b->bookID : a < b;
+    }
+    bool operator()(const Book *a, std::string_view name) const { return a->*Field < name; }
+    bool operator()(std::string_view name, const Book *b) const { return name < b->*Field; }
+};
+
+// InsertBook arguments, as collected for a bulk load. The names are views into
+// the caller's buffer and only need to outlive the BulkLoad call.
+struct BookRecord
+{
+    int bookID;
+    std::string_view bookName;
+    std::string_view authorName;
+    bool availability;
+};
+
+// One command of a batch for ApplyBatch. `patronID` is used by Borrow and
+// Return, `priority` by Borrow only.
+struct BookOperation
+{
+    enum Kind : std::uint8_t
+    {
+        Borrow,
+        Return,
+        Print
+    };
+    Kind kind;
+    int bookID;
+    int patronID;
+    int priority;
+};
+
+// Library calls whose latency is recorded when instrumentation is compiled in.
+enum class TimedCall : std::uint8_t
+{
+    InsertBook,
+    BulkLoad,
+    PrintBook,
+    PrintBooks,
+    BorrowBook,
+    ReturnBook,
+    FindClosestBook,
+    DeleteBook,
+    CountBooks,
+    SelectBook,
+    RankOf,
+    CancelReservation,
+    UpdatePriority,
+    PrintPatron,
+    ReturnAll,
+    FindByAuthor,
+    FindByTitlePrefix,
+    ApplyBatch,
+    SaveSnapshot,
+    LoadSnapshot,
+    DeleteRange,
+    MergeLibrary,
+    Count
+};
+
+inline const char *timedCallName(int call)
+{
+    static const char *const names[] = {"InsertBook", "BulkLoad", "PrintBook", "PrintBooks", "BorrowBook", "ReturnBook",
+                                        "FindClosestBook", "DeleteBook", "CountBooks", "SelectBook", "RankOf",
+                                        "CancelReservation", "UpdatePriority", "PrintPatron", "ReturnAll", "FindByAuthor",
+                                        "FindByTitlePrefix", "ApplyBatch", "SaveSnapshot", "LoadSnapshot", "DeleteRange",
+                                        "MergeLibrary"};
+    static_assert(sizeof(names) / sizeof(names[0]) == static_cast<int>(TimedCall::Count), "one name per call");
+    return names[call];
+}
+
+// The catalog: books keyed by bookID, with subtree sizes for rank and select.
+using BookTree = RBTree<int, Book *, std::less<int>, SlabPool, SubtreeSize>;
+using RBNode = BookTree::Node;
+
+// Position in bookID order. Stepping uses parent pointers, so walking k books
+// costs O(k) with no recursion or stack. A cursor is invalidated by any
+// insert or delete.
+class BookCursor
+{
+private:
+    RBNode *node = nullptr;
+
+public:
+    BookCursor() = default;
+    explicit BookCursor(RBNode *node) : node(node) {}
+
+    bool valid() const { return node != nullptr; }
+    int bookID() const { return node->key; }
+    const Book &book() const { return *node->value; }
+    RBNode *get() const { return node; }
+
+    BookCursor &next()
+    { // Moves to the in-order successor (invalid past the last book).
+
+        node = BookTree::next(node);
+        return *this;
+    }
+
+    BookCursor &prev()
+    { // Moves to the in-order predecessor (invalid before the first book).
+
+        node = BookTree::prev(node);
+        return *this;
+    }
+};
+
+// The bookID index BasicGatorLibrary runs on. An index owns its nodes but not
+// the books, and offers the same small set of operations over Book pointers,
+// so the library can run on a red-black tree or on a B+-tree.
+//
+// With duplicate bookIDs, find() and erase() agree on which book they mean,
+// but the two indexes may not pick the same one.
+class RBTreeIndex
+{
+public:
+    using Cursor = BookCursor;
+
+    struct FingerStep
+    { // One node on the path of the previous search, with the open range of IDs its subtree can hold.
+        RBNode *node;
+        long long lower;
+        long long upper;
+    };
+    using Finger = std::vector<FingerStep>;
+
+private:
+    BookTree tree;
+
+    static int sizeOf(const RBNode *node) { return SubtreeSize::of(node); }
+
+public:
+    Book *find(int bookID) const
+    {
+        RBNode *node = tree.find(bookID);
+        return node ? node->value : nullptr;
+    }
+
+    Cursor lowerBound(int bookID) const { return Cursor(tree.lowerBound(bookID)); }
+    Cursor upperBound(int bookID) const { return Cursor(tree.upperBound(bookID)); }
+    Cursor first() const { return Cursor(tree.first()); }
+    Cursor last() const { return Cursor(tree.last()); }
+    bool empty() const { return tree.empty(); }
+    int size() const { return sizeOf(tree.root()); }
+
+    void insert(Book *book) { tree.insert(book->bookID, book); }
+
+    void erase(int bookID) { tree.erase(tree.find(bookID)); } // The book find() returns.
+
+    template <typename Dispose>
+    void eraseRange(int bookID1, int bookID2, Dispose dispose) { tree.eraseRange(bookID1, bookID2, dispose); }
+
+    void join(RBTreeIndex &other) { tree.join(other.tree); } // Key ranges must not interleave.
+
+    Book *fingerFind(Finger &path, int bookID) const
+    { // find for a nondecreasing sequence of bookIDs. Climbs the previous search path only
+      // until a subtree that must hold bookID, then descends from there: O(log d) for a gap of d books.
+
+        if (tree.empty())
+            return nullptr;
+        if (path.empty())
+            path.push_back({tree.root(), LLONG_MIN, LLONG_MAX});
+        while (path.size() > 1 && !(path.back().lower < bookID && bookID < path.back().upper))
+            path.pop_back();
+        for (;;)
+        {
+            FingerStep at = path.back();
+            RBNode *node = at.node;
+            __builtin_prefetch(node->left); // Both children are in flight while the key is compared.
+            __builtin_prefetch(node->right);
+            if (bookID == node->key)
+                return node->value;
+            if (bookID < node->key)
+            {
+                if (node->left == nullptr)
+                    return nullptr;
+                path.push_back({node->left, at.lower, node->key});
+            }
+            else
+            {
+                if (node->right == nullptr)
+                    return nullptr;
+                path.push_back({node->right, node->key, at.upper});
+            }
+        }
+    }
+
+    int countBelow(int bookID, bool inclusive) const
+    { // Number of books with an ID below bookID (or at most bookID when inclusive).
+
+        int count = 0;
+        RBNode *node = tree.root();
+        while (node != nullptr)
+        {
+            if (bookID < node->key || (!inclusive && bookID == node->key))
+                node = node->left;
+            else
+            {
+                count += sizeOf(node->left) + 1;
+                node = node->right;
+            }
+        }
+        return count;
+    }
+
+    Book *select(int rank) const
+    { // The book with the rank-th smallest bookID (1-based).
+
+        RBNode *node = tree.root();
+        while (node != nullptr)
+        {
+            int leftSize = sizeOf(node->left);
+            if (rank <= leftSize)
+                node = node->left;
+            else if (rank == leftSize + 1)
+                return node->value;
+            else
+            {
+                rank -= leftSize + 1;
+                node = node->right;
+            }
+        }
+        return nullptr;
+    }
+
+    void buildFromSorted(const std::vector<Book *> &books)
+    { // Bottom-up in O(n) with no rotations or fixups. The index must be empty.
+
+        std::vector<RBNode *> nodes;
+        nodes.reserve(books.size());
+        for (Book *book : books)
+            nodes.push_back(tree.createNode(book->bookID, book));
+        tree.buildFromSorted(nodes);
+    }
+
+    void describe(std::vector<SnapshotBook> &records, std::vector<const Book *> &byIndex) const
+    { // Fills in the tree's shape (parent and color) and book per in-order index. O(n).
+
+        std::size_t n = static_cast<std::size_t>(size());
+        records.assign(n, SnapshotBook{});
+        byIndex.assign(n, nullptr);
+
+        // Pre-order walk; a node's in-order index follows from the subtree sizes.
+        struct Visit
+        {
+            RBNode *node;
+            long index;
+            long parent;
+        };
+        std::vector<Visit> stack;
+        if (tree.root())
+            stack.push_back({tree.root(), sizeOf(tree.root()->left), -1});
+        while (!stack.empty())
+        {
+            Visit visit = stack.back();
+            stack.pop_back();
+            records[visit.index].parent = static_cast<std::int32_t>(visit.parent);
+            records[visit.index].color = visit.node->color();
+            byIndex[visit.index] = visit.node->value;
+            if (RBNode *left = visit.node->left)
+                stack.push_back({left, visit.index - 1 - sizeOf(left->right), visit.index});
+            if (RBNode *right = visit.node->right)
+                stack.push_back({right, visit.index + 1 + sizeOf(right->left), visit.index});
+        }
+    }
+
+    void assign(const std::vector<Book *> &books, const SnapshotBook *records, const std::vector<int> &sizes)
+    { // Rebuilds the exact tree a validated snapshot describes. The index must be empty.
+
+        std::size_t n = books.size();
+        std::vector<RBNode *> nodes(n);
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            nodes[i] = tree.createNode(books[i]->bookID, books[i]);
+            nodes[i]->setColor(static_cast<Color>(records[i].color));
+            nodes[i]->data = sizes[i];
+        }
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            int parent = records[i].parent;
+            if (parent == -1)
+            {
+                tree.adopt(nodes[i]);
+                continue;
+            }
+            nodes[i]->setParent(nodes[parent]);
+            (i < static_cast<std::size_t>(parent) ? nodes[parent]->left : nodes[parent]->right) = nodes[i];
+        }
+    }
+
+    template <typename Dispose>
+    void clear(Dispose dispose) { tree.clear(dispose); }
+
+    int colorFlips() const { return tree.colorFlips(); }
+    void setColorFlips(int count) { tree.setColorFlips(count); }
+
+    static constexpr const char *kName = "rbtree";
+    const TreeCounters &counters() const { return tree.counters(); }
+    TreeShape shape() const { return tree.shape(); }
+};
+
+using BookBTree = BPlusTree<Book *>;
+
+// BookCursor for the B+-tree index.
+class BTreeCursor
+{
+private:
+    BookBTree::Cursor at;
+
+public:
+    BTreeCursor() = default;
+    explicit BTreeCursor(BookBTree::Cursor at) : at(at) {}
+
+    bool valid() const { return at.valid(); }
+    int bookID() const { return at.key(); }
+    const Book &book() const { return *at.value(); }
+
+    BTreeCursor &next()
+    {
+        at.next();
+        return *this;
+    }
+
+    BTreeCursor &prev()
+    {
+        at.prev();
+        return *this;
+    }
+};
+
+// The B+-tree index. It does no recoloring, so it reports no color flips;
+// snapshots record a balanced red-black shape for its books, which either
+// index can load.
+class BTreeIndex
+{
+public:
+    using Cursor = BTreeCursor;
+    using Finger = BookBTree::Leaf *;
+
+private:
+    BookBTree tree;
+
+    static void balancedShape(std::vector<SnapshotBook> &records, long lo, long hi, long parent, int depth, int redDepth)
+    { // The shape RBTree::buildFromSorted gives books lo..hi: midpoints at the top, only the bottom level red.
+
+        if (lo > hi)
+            return;
+        long mid = lo + (hi - lo) / 2;
+        records[mid].parent = static_cast<std::int32_t>(parent);
+        records[mid].color = depth == redDepth && depth > 0 ? RED : BLACK;
+        balancedShape(records, lo, mid - 1, mid, depth + 1, redDepth);
+        balancedShape(records, mid + 1, hi, mid, depth + 1, redDepth);
+    }
+
+public:
+    Book *find(int bookID) const
+    {
+        BookBTree::Cursor found = tree.find(bookID);
+        return found.valid() ? found.value() : nullptr;
+    }
+
+    Cursor lowerBound(int bookID) const { return Cursor(tree.lowerBound(bookID)); }
+    Cursor upperBound(int bookID) const { return Cursor(tree.upperBound(bookID)); }
+    Cursor first() const { return Cursor(tree.first()); }
+    Cursor last() const { return Cursor(tree.last()); }
+    bool empty() const { return tree.empty(); }
+    int size() const { return tree.size(); }
+
+    void insert(Book *book) { tree.insert(book->bookID, book); }
+
+    void erase(int bookID) { tree.erase(tree.find(bookID)); }
+
+    template <typename Dispose>
+    void eraseRange(int bookID1, int bookID2, Dispose dispose) { tree.eraseRange(bookID1, bookID2, dispose); }
+
+    void join(BTreeIndex &other) { tree.join(other.tree); } // Key ranges must not interleave.
+
+    Book *fingerFind(Finger &finger, int bookID) const
+    {
+        BookBTree::Cursor found = tree.find(finger, bookID);
+        return found.valid() ? found.value() : nullptr;
+    }
+
+    int countBelow(int bookID, bool inclusive) const { return tree.countBelow(bookID, inclusive); }
+
+    Book *select(int rank) const
+    {
+        BookBTree::Cursor found = tree.select(rank);
+        return found.valid() ? found.value() : nullptr;
+    }
+
+    void buildFromSorted(const std::vector<Book *> &books)
+    {
+        std::vector<int> keys;
+        keys.reserve(books.size());
+        for (const Book *book : books)
+            keys.push_back(book->bookID);
+        tree.buildFromSorted(keys, books);
+    }
+
+    void describe(std::vector<SnapshotBook> &records, std::vector<const Book *> &byIndex) const
+    {
+        std::size_t n = static_cast<std::size_t>(size());
+        records.assign(n, SnapshotBook{});
+        byIndex.clear();
+        byIndex.reserve(n);
+        for (BookBTree::Cursor it = tree.first(); it.valid(); it.next())
+            byIndex.push_back(it.value());
+        int redDepth = 0;
+        while ((std::size_t(2) << redDepth) <= n)
+            ++redDepth;
+        balancedShape(records, 0, static_cast<long>(n) - 1, -1, 0, redDepth);
+    }
+
+    void assign(const std::vector<Book *> &books, const SnapshotBook *, const std::vector<int> &) { buildFromSorted(books); }
+
+    template <typename Dispose>
+    void clear(Dispose dispose) { tree.clear(dispose); }
+
+    int colorFlips() const { return 0; }
+    void setColorFlips(int) {}
+
+    static constexpr const char *kName = "btree";
+    const TreeCounters &counters() const { return tree.counters(); }
+    TreeShape shape() const { return tree.shape(); }
+};
+
+// Console echo for InsertBook.
+inline void printInsertResult(OutputSink &console, bool inserted)
+{
+    console << (inserted ? "Book  inserted into Red-Black tree: " : "Book not inserted into Red-Black tree: ");
+}
+
+// One version of a library's catalog, pinned by BasicGatorLibrary::Pin. It
+// never changes, and reading it takes no lock: any number of threads may scan
+// it while the library moves on. Versions share whatever did not change
+// between them (see persistent_rb_tree.h); a version's own nodes go with its
+// last copy. The names point into the library, so no version may outlive it.
+class CatalogVersion
+{
+public:
+    using Images = std::shared_ptr<const std::vector<BookImage>>; // The books with one bookID, in catalog order.
+
+private:
+    PersistentRBTree<int, Images> books;
+    int bookCount = 0;
+    std::uint64_t number = 0;
+    std::shared_ptr<const void> snapshotFile; // The loaded image the titles may point into, kept mapped.
+
+    template <typename Index>
+    friend class BasicGatorLibrary;
+
+public:
+    std::uint64_t Sequence() const { return number; } // Versions the library had published up to this one; 0 for none.
+    int Size() const { return bookCount; }
+
+    template <typename Visit>
+    void ForEach(int bookID1, int bookID2, Visit visit) const
+    { // Calls visit(const BookImage &) for every book with an ID in [bookID1, bookID2], in ID order.
+
+        books.forEach(bookID1, bookID2, [&](int, const Images &images)
+                      {
+            for (const BookImage &book : *images)
+                visit(book); });
+    }
+
+    void PrintBook(int bookID, OutputSink &output) const
+    {
+        const Images *images = books.find(bookID);
+        if (images)
+            printBookBlock((*images)->front(), output);
+        else
+            output << "Book " << bookID << " not found in the Library" << '\n';
+    }
+
+    void PrintBooks(int bookID1, int bookID2, OutputSink &output) const
+    {
+        ForEach(bookID1, bookID2, [&](const BookImage &book)
+                { printBookBlock(book, output); });
+    }
+};
+
+// Main class for the GatorLibrary system.
+//
+// In thread-safe mode the commands may be called from several threads.
+// Inserts and deletes change the tree's shape and take treeMutex
+// exclusively. Every other command holds it shared, so readers run in
+// parallel. State inside a book is guarded by one of a fixed set of striped
+// locks, which lets BorrowBook and ReturnBook on different books proceed
+// together. The cursor API is never synchronized.
+//
+// PrintBooks and FindClosestBook results are cached (see query_cache.h).
+// Every change to a book invalidates the cached results that cover its ID,
+// while the change still holds the book's locks.
+//
+// After EnableVersions() the same changes also publish a new CatalogVersion,
+// which copies the O(log n) path to the book and shares everything else.
+// Pin() hands out the latest one. Scanning a pinned version takes no lock,
+// so long exports and the commands changing the library never wait for each
+// other.
+//
+// Index is the bookID index: RBTreeIndex or BTreeIndex (see above).
+template <typename Index>
+class BasicGatorLibrary
+{
+private:
+    struct alignas(64) BookLock
+    {
+        std::mutex mutex;
+    };
+    static constexpr int kBookLockStripes = 64;
+    static constexpr std::size_t kMinBookDetailsBytes = 80; // Shortest PrintBook block, give or take.
+
+    Index catalog;
+    SlabPool<Book> bookPool;
+    bool threadSafe = false;
+    bool recordReservationTimes = false;
+    std::atomic<std::uint64_t> reservationSequence{0}; // Orders reservations across the library; BorrowBook runs under a shared lock.
+    mutable std::shared_mutex treeMutex;
+    mutable BookLock bookLocks[kBookLockStripes];
+
+    struct PatronBooks
+    { // Sorted bookIDs a patron holds or waits for.
+        std::vector<int> held;
+        std::vector<int> reserved;
+    };
+    std::unordered_map<int, PatronBooks> patrons; // Secondary index by patronID.
+    // Built on the first FindByAuthor/FindByTitlePrefix, then kept up to date.
+    mutable std::set<Book *, ByName<&Book::authorName>> authorIndex;
+    mutable std::set<Book *, ByName<&Book::bookName>> titleIndex;
+    mutable std::once_flag nameIndexOnce;
+    mutable std::atomic<bool> nameIndexed{false};
+
+    struct AdoptedText
+    { // Input text that book names may point into directly, and what keeps it alive.
+        std::string_view text;
+        std::shared_ptr<const void> owner;
+    };
+    std::vector<AdoptedText> adoptedTexts;
+    std::shared_ptr<const void> snapshotFile; // The loaded image (or merged images) the books' titles point into.
+    StringArena titles;
+    StringInterner authors; // Few authors write many books; each name is stored once.
+    mutable std::mutex patronMutex;                // Guards `patrons`; always taken after a book lock.
+    WriteAheadLog *log = nullptr;                  // Mutations are appended here before they are applied.
+    std::uint64_t snapshotLogSequence = 0;         // Last log record reflected in the loaded snapshot.
+    mutable LatencyHistogram latencies[static_cast<int>(TimedCall::Count)];
+    QueryCache queryCache;
+    std::mutex cacheMutex; // Guards queryCache; taken last, and never held while taking another lock.
+    CatalogVersion current; // The latest version, while versions are kept.
+    bool versioned = false;
+    std::mutex publishMutex;     // Orders publishing; taken after the book locks.
+    mutable std::mutex pinMutex; // Guards `current` while it is copied or replaced, and for nothing longer.
+
+    ScopedLatency timeCall(TimedCall call) const { return ScopedLatency(latencies[static_cast<int>(call)]); }
+
+    std::shared_lock<std::shared_mutex> readLock() const
+    {
+        return threadSafe ? std::shared_lock<std::shared_mutex>(treeMutex) : std::shared_lock<std::shared_mutex>();
+    }
+
+    std::unique_lock<std::shared_mutex> writeLock()
+    {
+        return threadSafe ? std::unique_lock<std::shared_mutex>(treeMutex) : std::unique_lock<std::shared_mutex>();
+    }
+
+    std::unique_lock<std::mutex> lockBook(int bookID) const
+    {
+        if (!threadSafe)
+            return std::unique_lock<std::mutex>();
+        return std::unique_lock<std::mutex>(bookLocks[static_cast<unsigned>(bookID) % kBookLockStripes].mutex);
+    }
+
+    std::unique_lock<std::mutex> lockPatrons() const
+    {
+        return threadSafe ? std::unique_lock<std::mutex>(patronMutex) : std::unique_lock<std::mutex>();
+    }
+
+    std::unique_lock<std::mutex> lockCache()
+    {
+        return threadSafe ? std::unique_lock<std::mutex>(cacheMutex) : std::unique_lock<std::mutex>();
+    }
+
+    std::unique_lock<std::mutex> lockPublish()
+    {
+        return threadSafe ? std::unique_lock<std::mutex>(publishMutex) : std::unique_lock<std::mutex>();
+    }
+
+    void booksChanged(int low, int high)
+    { // Drops cached results that cover IDs in [low, high] and, if versions are kept, publishes one
+      // with those books as they are now. Call after the change, under the locks that guard it.
+
+        {
+            auto cacheGuard = lockCache();
+            queryCache.invalidate(low, high);
+        }
+        if (versioned)
+            publish(low, high);
+    }
+
+    void bookChanged(int bookID) { booksChanged(bookID, bookID); }
+
+    void allBooksChanged()
+    { // booksChanged for the whole catalog, after it was loaded, replaced or emptied.
+
+        {
+            auto cacheGuard = lockCache();
+            queryCache.clear();
+        }
+        if (versioned)
+            republish();
+    }
+
+    static BookImage imageOf(const Book &book)
+    {
+        BookImage image{book.bookID, book.bookName, book.authorName, book.availabilityStatus, book.borrowedBy, {}};
+        image.reservations.reserve(book.reservationHeap.size());
+        book.reservationHeap.forEachInOrder([&](const ReservationNode &reservation)
+                                            { image.reservations.push_back(reservation.patronID); });
+        return image;
+    }
+
+    void replaceVersion(CatalogVersion &next)
+    { // Makes next the current version; next gets the old one, to release once no lock is held.
+
+        std::lock_guard<std::mutex> pinGuard(pinMutex);
+        std::swap(current, next);
+    }
+
+    void publish(int low, int high)
+    { // Publishes a copy of the current version with the books in [low, high] brought up to date:
+      // O(log n) per book changed, added or removed there.
+
+        auto publishGuard = lockPublish();
+        CatalogVersion next = current;
+        std::vector<int> listed; // IDs the current version has in the range.
+        next.books.forEach(low, high, [&](int bookID, const CatalogVersion::Images &images)
+                           {
+            listed.push_back(bookID);
+            next.bookCount -= static_cast<int>(images->size()); });
+        auto stale = listed.begin();
+        for (Cursor it = LowerBound(low); it.valid() && it.bookID() <= high;)
+        {
+            int bookID = it.bookID();
+            auto images = std::make_shared<std::vector<BookImage>>();
+            for (; it.valid() && it.bookID() == bookID; it.next())
+                images->push_back(imageOf(it.book()));
+            for (; stale != listed.end() && *stale < bookID; ++stale)
+                next.books.erase(*stale);
+            if (stale != listed.end() && *stale == bookID)
+                ++stale;
+            next.bookCount += static_cast<int>(images->size());
+            next.books.assign(bookID, std::move(images));
+        }
+        for (; stale != listed.end(); ++stale)
+            next.books.erase(*stale);
+        next.snapshotFile = snapshotFile;
+        ++next.number;
+        replaceVersion(next);
+    }
+
+    void republish()
+    { // Publishes a version built afresh from the whole catalog, in O(n).
+
+        auto publishGuard = lockPublish();
+        std::vector<std::pair<int, CatalogVersion::Images>> books;
+        for (Cursor it = First(); it.valid();)
+        {
+            int bookID = it.bookID();
+            auto images = std::make_shared<std::vector<BookImage>>();
+            for (; it.valid() && it.bookID() == bookID; it.next())
+                images->push_back(imageOf(it.book()));
+            books.emplace_back(bookID, std::move(images));
+        }
+        CatalogVersion next;
+        next.books = PersistentRBTree<int, CatalogVersion::Images>::fromSorted(books);
+        next.bookCount = catalog.size();
+        next.number = current.number + 1;
+        next.snapshotFile = snapshotFile;
+        replaceVersion(next);
+    }
+
+    template <typename Query>
+    void cachedQuery(QueryCache::Kind kind, int first, int second, std::size_t leastBytes, OutputSink &output, Query query)
+    { // Serves a query from the cache. Otherwise runs query, which prints the result to the sink it is
+      // given and returns the interval of bookIDs the result depends on; if the cache admits the
+      // query, the result goes through a side buffer and is stored. A result known to print at least
+      // leastBytes is never stored if the cache could not keep it.
+
+        std::uint64_t epoch;
+        {
+            auto cacheGuard = lockCache();
+            bool store = leastBytes <= queryCache.largestEntry();
+            if (store && queryCache.emit(kind, first, second, output))
+                return;
+            if (!store || !queryCache.admit(kind, first, second))
+            {
+                cacheGuard = {};
+                query(output);
+                return;
+            }
+            epoch = queryCache.epoch();
+        }
+        OutputSink captured;
+        QueryCache::Interval depends = query(captured);
+        output << captured.contents();
+        auto cacheGuard = lockCache();
+        queryCache.store(kind, first, second, depends, captured.contents(), epoch);
+    }
+
+    void indexBook(int patronID, int bookID, std::vector<int> PatronBooks::*list)
+    {
+        auto guard = lockPatrons();
+        std::vector<int> &books = patrons[patronID].*list;
+        books.insert(std::upper_bound(books.begin(), books.end(), bookID), bookID);
+    }
+
+    void unindexBook(int patronID, int bookID, std::vector<int> PatronBooks::*list)
+    {
+        auto guard = lockPatrons();
+        auto found = patrons.find(patronID);
+        if (found == patrons.end())
+            return;
+        std::vector<int> &books = found->second.*list;
+        auto at = std::lower_bound(books.begin(), books.end(), bookID);
+        if (at != books.end() && *at == bookID)
+            books.erase(at);
+        if (found->second.held.empty() && found->second.reserved.empty())
+            patrons.erase(found);
+    }
+
+    std::string_view storeTitle(std::string_view title)
+    { // Titles inside adopted input are used in place; anything else is copied into the arena.
+
+        for (const AdoptedText &adopted : adoptedTexts)
+            if (title.data() >= adopted.text.data() && title.data() + title.size() <= adopted.text.data() + adopted.text.size())
+                return title;
+        return titles.store(title);
+    }
+
+    Book *createBook(int bookID, std::string_view bookName, std::string_view authorName, bool titleKept = false)
+    { // Allocates an available book and enters it in the name indexes, once they exist. With titleKept
+      // the title already lies in storage the library keeps, and is used as it is.
+
+        Book *book = bookPool.create(bookID, titleKept ? bookName : storeTitle(bookName), authors.intern(authorName), true);
+        if (nameIndexed.load(std::memory_order_relaxed))
+        {
+            authorIndex.insert(book);
+            titleIndex.insert(book);
+        }
+        return book;
+    }
+
+    template <typename NameIndex>
+    static void fillSorted(std::vector<Book *> books, NameIndex &index)
+    { // Fills an empty name index in sorted order, so every insert is an O(1) append at the hint.
+
+        std::sort(books.begin(), books.end(), index.key_comp());
+        for (Book *book : books)
+            index.insert(index.end(), book);
+    }
+
+    void ensureNameIndexes() const
+    { // Runs under the shared lock at worst: writers are excluded and concurrent readers wait here.
+
+        std::call_once(nameIndexOnce, [this]
+                       {
+            std::vector<Book *> books;
+            books.reserve(catalog.size());
+            for (Cursor it = First(); it.valid(); it.next())
+                books.push_back(const_cast<Book *>(&it.book()));
+            fillSorted(books, authorIndex);
+            fillSorted(std::move(books), titleIndex);
+            nameIndexed.store(true, std::memory_order_release); });
+    }
+
+    void destroyBook(Book *book)
+    {
+        if (nameIndexed.load(std::memory_order_relaxed))
+        {
+            authorIndex.erase(book);
+            titleIndex.erase(book);
+        }
+        bookPool.destroy(book);
+    }
+
+    void borrowBook(Book *book, int patronID, int patronPriority, OutputSink &output)
+    { // BorrowBook once the book is found and locked: lends it out, or queues the patron.
+
+        int bookID = book->bookID;
+        if (log)
+            log->values(WriteAheadLog::Op::BorrowBook, {patronID, bookID, patronPriority});
+        if (book->availabilityStatus)
+        {
+            book->availabilityStatus = false;
+            book->borrowedBy = patronID;
+            indexBook(patronID, bookID, &PatronBooks::held);
+            output << "Book " << bookID << " Borrowed by Patron " << patronID << '\n';
+        }
+        else
+        {
+            if (!book->reservationHeap.contains(patronID))
+                indexBook(patronID, bookID, &PatronBooks::reserved);
+            book->addReservation(patronID, patronPriority, reservationSequence.fetch_add(1, std::memory_order_relaxed),
+                                 recordReservationTimes ? time(0) : 0);
+            output << "\nBook " << bookID << " Reserved by Patron " << patronID << '\n';
+        }
+        bookChanged(bookID);
+    }
+
+    void returnBook(Book *book, int patronID, OutputSink &output)
+    { // ReturnBook once the book is found and locked: hands it to the next waiter, if any.
+
+        if (book->availabilityStatus || book->borrowedBy != patronID)
+        {
+            output << "Book " << book->bookID << " is not borrowed by Patron " << patronID << '\n';
+            return;
+        }
+        unindexBook(patronID, book->bookID, &PatronBooks::held);
+        output << "Book " << book->bookID << " Returned by Patron " << patronID << '\n'
+               << '\n';
+
+        if (!book->reservationHeap.empty())
+        {
+            ReservationNode topReservation = book->reservationHeap.top();
+            book->removeReservation();
+            book->borrowedBy = topReservation.patronID;
+            unindexBook(topReservation.patronID, book->bookID, &PatronBooks::reserved);
+            indexBook(topReservation.patronID, book->bookID, &PatronBooks::held);
+            output << "Book " << book->bookID << " Allotted to Patron " << topReservation.patronID << '\n';
+        }
+        else
+        {
+            book->borrowedBy = -1;
+            book->availabilityStatus = true;
+        }
+        bookChanged(book->bookID);
+    }
+
+    void retireBook(const Book &book, OutputSink &output)
+    { // DeleteBook's part before the book goes: drops its patron entries and reports the cancellations.
+
+        int bookID = book.bookID;
+        if (!book.availabilityStatus)
+            unindexBook(book.borrowedBy, bookID, &PatronBooks::held);
+        book.reservationHeap.forEachInOrder([&](const ReservationNode &reservation)
+                                            { unindexBook(reservation.patronID, bookID, &PatronBooks::reserved); });
+
+        output << "\nBook " << bookID << " is no longer available.";
+        if (book.reservationHeap.empty())
+            output << '\n';
+        else if (book.reservationHeap.size() == 1)
+            output << " Reservation made by Patron " << book.reservationHeap.top().patronID << " has been cancelled!\n";
+        else
+        {
+            output << " Reservations made by Patrons ";
+            printWaitingPatrons(book, output);
+            output << " have been cancelled!\n";
+        }
+    }
+
+    static void spliceIDs(std::vector<int> &into, const std::vector<int> &ids)
+    { // Adds sorted ids to sorted into, where they form one run: all below or all above into's own.
+
+        if (!ids.empty())
+            into.insert(std::upper_bound(into.begin(), into.end(), ids.front()), ids.begin(), ids.end());
+    }
+
+    void deleteBook(Book *book)
+    { // Removes a book from the index and recycles its slot.
+
+        int bookID = book->bookID;
+        catalog.erase(bookID);
+        destroyBook(book);
+        bookChanged(bookID);
+    }
+
+    template <typename Visit>
+    void forEachTitlePrefix(std::string_view prefix, Visit visit) const
+    { // Visits the books whose title starts with prefix, in title order, in O(log n + k).
+
+        ensureNameIndexes();
+        for (auto it = titleIndex.lower_bound(prefix); it != titleIndex.end(); ++it)
+        {
+            if (std::string_view((*it)->bookName).substr(0, prefix.size()) != prefix)
+                break;
+            visit(**it);
+        }
+    }
+
+    void printBookDetails(const Book &book, OutputSink &output)
+    { // Prints the PrintBook block for one book.
+
+        auto bookGuard = lockBook(book.bookID);
+        printBookBlock(book, output);
+    }
+
+    void printBookInfo(const Book &book, OutputSink &output)
+    { // Prints information about a book.
+
+        output << "BookID: " << book.bookID << " - Title: " << book.bookName << " - Author: " << book.authorName << " - Available: " << (book.availabilityStatus ? "Yes" : "No") << " - Borrowed by: " << book.borrowedBy << '\n';
+    }
+
+    static int heightBound(std::uint64_t books)
+    { // 2 log2(n + 1) rounded up: no red-black tree of n nodes is taller.
+
+        int bits = 0;
+        while ((std::uint64_t(1) << bits) <= books)
+            ++bits;
+        return books == 0 ? 0 : 2 * bits;
+    }
+
+    bool validateSnapshot(const SnapshotHeader &header, const SnapshotBook *records, const SnapshotReservation *waiting,
+                          std::vector<int> &sizes, std::vector<ReservationHeap> &heaps) const
+    { // Checks that the records describe one valid red-black tree in bookID order, with names inside
+      // the text and a valid heap per book. Fills in subtree sizes and the heaps. O(n).
+
+        std::size_t n = header.books;
+        std::vector<int> left(n, -1), right(n, -1);
+        long rootIndex = -1;
+        std::uint64_t reservations = 0;
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            const SnapshotBook &record = records[i];
+            if ((i > 0 && record.bookID < records[i - 1].bookID) || record.color > BLACK ||
+                record.titleOffset > header.stringBytes || record.titleLength > header.stringBytes - record.titleOffset ||
+                record.authorOffset > header.stringBytes || record.authorLength > header.stringBytes - record.authorOffset)
+                return false;
+            if (record.parent == -1)
+            {
+                if (rootIndex != -1)
+                    return false;
+                rootIndex = static_cast<long>(i);
+            }
+            else
+            {
+                if (record.parent < 0 || static_cast<std::size_t>(record.parent) >= n || static_cast<std::size_t>(record.parent) == i)
+                    return false;
+                int &slot = i < static_cast<std::size_t>(record.parent) ? left[record.parent] : right[record.parent];
+                if (slot != -1)
+                    return false;
+                slot = static_cast<int>(i);
+            }
+            reservations += record.reservationCount;
+            if (reservations > header.reservations)
+                return false;
+        }
+        if (reservations != header.reservations || (n > 0 && (rootIndex == -1 || records[rootIndex].color != BLACK)))
+            return false;
+        if (n == 0)
+            return true;
+
+        // Pre-order from the root: every node must be reachable, no red node may have a red
+        // parent, and every null link must sit under the same number of black nodes.
+        std::vector<int> order, blackDepth(n, 0);
+        order.reserve(n);
+        std::vector<int> stack{static_cast<int>(rootIndex)};
+        int blackHeight = -1;
+        while (!stack.empty())
+        {
+            int i = stack.back();
+            stack.pop_back();
+            order.push_back(i);
+            int parent = records[i].parent;
+            blackDepth[i] = (parent == -1 ? 0 : blackDepth[parent]) + (records[i].color == BLACK);
+            if (parent != -1 && records[i].color == RED && records[parent].color == RED)
+                return false;
+            for (int child : {left[i], right[i]})
+            {
+                if (child != -1)
+                    stack.push_back(child);
+                else if (blackHeight == -1)
+                    blackHeight = blackDepth[i];
+                else if (blackHeight != blackDepth[i])
+                    return false;
+            }
+        }
+        if (order.size() != n)
+            return false;
+
+        sizes.assign(n, 1);
+        for (auto it = order.rbegin(); it != order.rend(); ++it)
+            if (records[*it].parent != -1)
+                sizes[records[*it].parent] += sizes[*it];
+
+        // The links must also put every book at its own in-order position.
+        std::vector<long> start(n, 0);
+        for (int i : order)
+        {
+            long position = start[i] + (left[i] == -1 ? 0 : sizes[left[i]]);
+            if (position != i)
+                return false;
+            if (left[i] != -1)
+                start[left[i]] = start[i];
+            if (right[i] != -1)
+                start[right[i]] = position + 1;
+        }
+
+        heaps.resize(n);
+        const SnapshotReservation *next = waiting;
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            std::vector<ReservationNode> heap;
+            heap.reserve(records[i].reservationCount);
+            for (std::uint32_t r = 0; r < records[i].reservationCount; ++r, ++next)
+                heap.emplace_back(next->patronID, next->priority, next->sequence, static_cast<time_t>(next->timestamp));
+            if (!heaps[i].assignHeapOrder(std::move(heap)))
+                return false;
+        }
+        return true;
+    }
+
+public:
+    using Cursor = typename Index::Cursor;
+
+    BasicGatorLibrary() {} // Constructor for Gator Library.
+    explicit BasicGatorLibrary(bool threadSafe) : threadSafe(threadSafe) {}
+    BasicGatorLibrary(const BasicGatorLibrary &) = delete;
+    BasicGatorLibrary &operator=(const BasicGatorLibrary &) = delete;
+
+    ~BasicGatorLibrary()
+    { // Pools release their chunks in bulk afterwards.
+
+        catalog.clear([this](Book *book)
+                      { bookPool.destroy(book); });
+    }
+
+    template <typename Iterator>
+    BasicGatorLibrary(Iterator first, Iterator last) : BasicGatorLibrary() // Bulk-load constructor, see BulkLoad.
+    {
+        BulkLoad(first, last);
+    }
+
+    Cursor LowerBound(int bookID) const
+    { // First book with an ID of at least bookID.
+
+        return catalog.lowerBound(bookID);
+    }
+
+    Cursor UpperBound(int bookID) const
+    { // First book with an ID greater than bookID.
+
+        return catalog.upperBound(bookID);
+    }
+
+    Cursor First() const { return catalog.first(); }
+    Cursor Last() const { return catalog.last(); }
+
+    bool InsertBook(int bookID, std::string_view bookName, std::string_view authorName, bool availability, int borrowedBy)
+    { // Public methods for GatorLibrary operations...Includes methods like InsertBook, BorrowBook, ReturnBook, etc.
+      // Returns whether the book went into the tree (only available books do).
+
+        auto timer = timeCall(TimedCall::InsertBook);
+        if (!availability)
+            return false;
+        auto guard = writeLock();
+        if (log)
+            log->insertBook(bookID, bookName, authorName);
+        catalog.insert(createBook(bookID, bookName, authorName));
+        bookChanged(bookID);
+        return true;
+    }
+
+    void AdoptText(std::string_view text, std::shared_ptr<const void> owner)
+    { // Lets book names that lie inside text point into it instead of being copied; owner keeps it alive.
+
+        auto guard = writeLock();
+        adoptedTexts.push_back({text, std::move(owner)});
+    }
+
+    bool SaveSnapshot(const std::string &path, std::uint64_t logPosition = 0)
+    { // Writes the whole library to path (see snapshot.h). The image goes to a temporary file that
+      // replaces path only once it is complete. Returns false on any I/O error.
+
+        auto timer = timeCall(TimedCall::SaveSnapshot);
+        auto guard = writeLock();
+        std::vector<SnapshotBook> books;
+        std::vector<const Book *> byIndex;
+        catalog.describe(books, byIndex);
+        std::size_t n = books.size();
+
+        std::vector<SnapshotReservation> reservations;
+        std::string text;
+        std::unordered_map<const char *, std::uint64_t> authorOffsets; // Interned, so one author is one pointer.
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            const Book *book = byIndex[i];
+            SnapshotBook &record = books[i];
+            record.bookID = book->bookID;
+            record.borrowedBy = book->borrowedBy;
+            record.available = book->availabilityStatus;
+            for (const ReservationNode &reservation : book->reservationHeap.heapOrder())
+                reservations.push_back({reservation.patronID, reservation.priority, reservation.sequence, static_cast<std::int64_t>(reservation.timestamp)});
+            record.reservationCount = static_cast<std::uint32_t>(book->reservationHeap.size());
+            record.titleOffset = text.size();
+            record.titleLength = static_cast<std::uint32_t>(book->bookName.size());
+            text.append(book->bookName);
+            auto author = authorOffsets.try_emplace(book->authorName.data(), text.size());
+            if (author.second)
+                text.append(book->authorName);
+            record.authorOffset = author.first->second;
+            record.authorLength = static_cast<std::uint32_t>(book->authorName.size());
+        }
+
+        SnapshotHeader header{};
+        std::memcpy(header.magic, SnapshotHeader::kMagic, sizeof(header.magic));
+        header.version = SnapshotHeader::kVersion;
+        header.headerSize = sizeof(SnapshotHeader);
+        header.books = n;
+        header.reservations = reservations.size();
+        header.stringBytes = text.size();
+        header.reservationSequence = reservationSequence.load();
+        header.colorFlipCount = catalog.colorFlips();
+        header.logPosition = logPosition;
+        header.walSequence = log ? log->lastSequence() : snapshotLogSequence;
+
+        std::string temporary = path + ".tmp";
+        std::FILE *file = std::fopen(temporary.c_str(), "wb");
+        if (!file)
+            return false;
+        bool written = std::fwrite(&header, sizeof(header), 1, file) == 1 &&
+                       std::fwrite(books.data(), sizeof(SnapshotBook), n, file) == n &&
+                       std::fwrite(reservations.data(), sizeof(SnapshotReservation), reservations.size(), file) == reservations.size() &&
+                       std::fwrite(text.data(), 1, text.size(), file) == text.size() &&
+                       std::fflush(file) == 0 && ::fsync(fileno(file)) == 0;
+        if (std::fclose(file) != 0 || !written || std::rename(temporary.c_str(), path.c_str()) != 0)
+        {
+            std::remove(temporary.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    bool LoadSnapshot(const std::string &path, std::uint64_t *logPosition = nullptr, const SnapshotIdentity *expected = nullptr)
+    { // Replaces the library with the image at path in O(n): no comparisons, rotations or fixups.
+      // The file is checked first; if it is unusable, or is not the expected image (log replay asks
+      // for the one the run loaded), the library is left as it was and false is returned.
+
+        auto timer = timeCall(TimedCall::LoadSnapshot);
+        auto file = std::make_shared<MappedFile>(path);
+        if (!file->isOpen() || file->size() < sizeof(SnapshotHeader))
+            return false;
+        SnapshotHeader header;
+        std::memcpy(&header, file->data(), sizeof(header));
+        std::size_t room = file->size() - sizeof(header);
+        if (std::memcmp(header.magic, SnapshotHeader::kMagic, sizeof(header.magic)) != 0 || header.version != SnapshotHeader::kVersion ||
+            header.headerSize != sizeof(SnapshotHeader) || header.books > static_cast<std::uint64_t>(INT_MAX) ||
+            header.colorFlipCount < 0 || header.colorFlipCount > INT_MAX ||
+            header.books > room / sizeof(SnapshotBook) ||
+            header.reservations > (room - header.books * sizeof(SnapshotBook)) / sizeof(SnapshotReservation) ||
+            header.stringBytes != room - header.books * sizeof(SnapshotBook) - header.reservations * sizeof(SnapshotReservation))
+            return false;
+
+        const char *data = file->data() + sizeof(header);
+        const SnapshotBook *records = reinterpret_cast<const SnapshotBook *>(data);
+        const SnapshotReservation *waiting = reinterpret_cast<const SnapshotReservation *>(data + header.books * sizeof(SnapshotBook));
+        const char *text = data + header.books * sizeof(SnapshotBook) + header.reservations * sizeof(SnapshotReservation);
+        std::vector<int> sizes;
+        std::vector<ReservationHeap> heaps;
+        if (!validateSnapshot(header, records, waiting, sizes, heaps))
+            return false;
+
+        auto guard = writeLock();
+        if (log || expected)
+        { // Only a logged or replayed load needs the checksum, which takes a pass over the file.
+            SnapshotIdentity image{header.walSequence, file->size(), WriteAheadLog::crc32(file->data(), file->size())};
+            if (expected && (image.walSequence != expected->walSequence || image.size != expected->size || image.checksum != expected->checksum))
+                return false;
+            if (log)
+                log->loadSnapshot(path, image);
+        }
+        catalog.clear([this](Book *book)
+                      { bookPool.destroy(book); });
+        {
+            auto patronGuard = lockPatrons();
+            patrons.clear();
+        }
+        authorIndex.clear();
+        titleIndex.clear();
+        snapshotFile = file; // Titles stay in the mapping. No book points into the one it replaces.
+
+        std::size_t n = header.books;
+        std::vector<Book *> books(n);
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            const SnapshotBook &record = records[i];
+            Book *book = createBook(record.bookID, std::string_view(text + record.titleOffset, record.titleLength),
+                                    std::string_view(text + record.authorOffset, record.authorLength), true);
+            book->availabilityStatus = record.available != 0;
+            book->borrowedBy = record.borrowedBy;
+            book->reservationHeap = std::move(heaps[i]);
+            books[i] = book;
+        }
+        catalog.assign(books, records, sizes);
+
+        for (const Book *book : books)
+        {
+            if (!book->availabilityStatus)
+                indexBook(book->borrowedBy, book->bookID, &PatronBooks::held);
+            book->reservationHeap.forEachInOrder([&](const ReservationNode &reservation)
+                                                 { indexBook(reservation.patronID, book->bookID, &PatronBooks::reserved); });
+        }
+        catalog.setColorFlips(static_cast<int>(header.colorFlipCount));
+        allBooksChanged();
+        reservationSequence.store(header.reservationSequence);
+        snapshotLogSequence = header.walSequence;
+        if (logPosition)
+            *logPosition = header.logPosition;
+        return true;
+    }
+
+    template <typename Iterator>
+    void BulkLoad(Iterator first, Iterator last)
+    { // Inserts a range of BookRecords. On an empty library the tree is built bottom-up in O(n)
+      // (plus a sort if the range is not already ordered by bookID) with no rotations or fixups.
+
+        auto timer = timeCall(TimedCall::BulkLoad);
+        auto guard = writeLock();
+        if (log)
+            log->bulkLoad(first, last);
+        if (!catalog.empty())
+        {
+            for (; first != last; ++first)
+                if (first->availability)
+                    catalog.insert(createBook(first->bookID, first->bookName, first->authorName));
+            allBooksChanged();
+            return;
+        }
+
+        std::vector<Book *> books;
+        for (; first != last; ++first)
+            if (first->availability)
+                books.push_back(createBook(first->bookID, first->bookName, first->authorName));
+        if (books.empty())
+            return;
+
+        auto byID = [](const Book *a, const Book *b)
+        { return a->bookID < b->bookID; };
+        if (!std::is_sorted(books.begin(), books.end(), byID))
+            std::stable_sort(books.begin(), books.end(), byID); // Equal IDs keep insertion order, as inserts would.
+        catalog.buildFromSorted(books);
+        allBooksChanged();
+    }
+
+    void BorrowBook(int patronID, int bookID, int patronPriority, OutputSink &output)
+    {
+        auto timer = timeCall(TimedCall::BorrowBook);
+        auto guard = readLock();
+        Book *book = catalog.find(bookID);
+
+        if (book == nullptr)
+            return;
+        auto bookGuard = lockBook(bookID);
+        borrowBook(book, patronID, patronPriority, output);
+    }
+
+    void ReturnBook(int patronID, int bookID, OutputSink &output)
+    { // Only the patron holding the book can return it.
+
+        auto timer = timeCall(TimedCall::ReturnBook);
+        auto guard = readLock();
+        Book *book = catalog.find(bookID);
+
+        if (book == nullptr)
+            return;
+        auto bookGuard = lockBook(bookID);
+        if (log)
+            log->values(WriteAheadLog::Op::ReturnBook, {patronID, bookID});
+        returnBook(book, patronID, output);
+    }
+
+    void ApplyBatch(const std::vector<BookOperation> &batch, OutputSink &output)
+    { // Runs a batch of borrows, returns and prints with one walk of the tree. The batch is sorted
+      // by bookID and every book is found by finger search from the previous one, then each book's
+      // operations run in their original order under a single lock of the book. Results are written
+      // in that sorted order: by book, and per book in the order given.
+
+        auto timer = timeCall(TimedCall::ApplyBatch);
+        constexpr std::size_t kPrefetchDistance = 4; // Books whose data is fetched ahead of use.
+
+        std::vector<std::uint64_t> order(batch.size()); // bookID in the high half (sign flipped), position in the low.
+        for (std::size_t i = 0; i < batch.size(); ++i)
+            order[i] = static_cast<std::uint64_t>(static_cast<std::uint32_t>(batch[i].bookID) ^ 0x80000000u) << 32 | i;
+        std::sort(order.begin(), order.end());
+
+        auto guard = readLock();
+        std::vector<Book *> books;        // One per distinct bookID, null if it is not in the library.
+        std::vector<std::size_t> starts;  // Where each book's run begins in `order`.
+        typename Index::Finger finger{};
+        for (std::size_t i = 0; i < order.size(); ++i)
+        {
+            if (i > 0 && (order[i] >> 32) == (order[i - 1] >> 32))
+                continue;
+            starts.push_back(i);
+            books.push_back(catalog.fingerFind(finger, batch[static_cast<std::uint32_t>(order[i])].bookID));
+        }
+        starts.push_back(order.size());
+
+        for (std::size_t g = 0; g < books.size(); ++g)
+        {
+            if (g + kPrefetchDistance < books.size() && books[g + kPrefetchDistance])
+                __builtin_prefetch(books[g + kPrefetchDistance]);
+            Book *book = books[g];
+            int bookID = batch[static_cast<std::uint32_t>(order[starts[g]])].bookID;
+            std::unique_lock<std::mutex> bookGuard;
+            if (book)
+                bookGuard = lockBook(bookID);
+            for (std::size_t i = starts[g]; i < starts[g + 1]; ++i)
+            {
+                const BookOperation &op = batch[static_cast<std::uint32_t>(order[i])];
+                if (book == nullptr)
+                {
+                    if (op.kind == BookOperation::Print)
+                        output << "Book " << bookID << " not found in the Library" << '\n';
+                    continue;
+                }
+                switch (op.kind)
+                {
+                case BookOperation::Borrow:
+                    borrowBook(book, op.patronID, op.priority, output);
+                    break;
+                case BookOperation::Return:
+                    if (log)
+                        log->values(WriteAheadLog::Op::ReturnBook, {op.patronID, bookID});
+                    returnBook(book, op.patronID, output);
+                    break;
+                case BookOperation::Print:
+                    printBookBlock(*book, output); // The book is locked already.
+                    break;
+                }
+            }
+        }
+    }
+
+    void PrintPatron(int patronID, OutputSink &output)
+    { // Books the patron holds and waits for, straight from the patron index.
+
+        auto timer = timeCall(TimedCall::PrintPatron);
+        auto guard = readLock();
+        auto patronGuard = lockPatrons();
+        auto found = patrons.find(patronID);
+        if (found == patrons.end())
+            PrintPatronBooks(patronID, {}, {}, output);
+        else
+            PrintPatronBooks(patronID, found->second.held, found->second.reserved, output);
+    }
+
+    void ReturnAll(int patronID, OutputSink &output)
+    { // ReturnBook for every book the patron holds, in O(books held * log n).
+
+        if (ReturnHeldBooks(patronID, output) == 0)
+            PrintNothingToReturn(patronID, output);
+    }
+
+    int ReturnHeldBooks(int patronID, OutputSink &output)
+    { // Returns the patron's books in bookID order and says how many there were.
+
+        auto timer = timeCall(TimedCall::ReturnAll);
+        auto guard = readLock();
+        if (log)
+            log->values(WriteAheadLog::Op::ReturnAll, {patronID});
+        std::vector<int> held = HeldBy(patronID);
+        for (int bookID : held)
+        {
+            Book *book = catalog.find(bookID);
+            if (book == nullptr)
+                continue;
+            auto bookGuard = lockBook(bookID);
+            returnBook(book, patronID, output);
+        }
+        return static_cast<int>(held.size());
+    }
+
+    std::vector<int> HeldBy(int patronID) const
+    {
+        auto patronGuard = lockPatrons();
+        auto found = patrons.find(patronID);
+        return found == patrons.end() ? std::vector<int>() : found->second.held;
+    }
+
+    std::vector<int> ReservedBy(int patronID) const
+    {
+        auto patronGuard = lockPatrons();
+        auto found = patrons.find(patronID);
+        return found == patrons.end() ? std::vector<int>() : found->second.reserved;
+    }
+
+    static void PrintPatronBooks(int patronID, const std::vector<int> &held, const std::vector<int> &reserved, OutputSink &output)
+    { // Formats a PrintPatron result.
+
+        auto list = [&](const char *label, const std::vector<int> &books)
+        {
+            output << label << " = [";
+            for (std::size_t i = 0; i < books.size(); ++i)
+                output << (i ? ", " : "") << books[i];
+            output << "]\n";
+        };
+        output << "\nPatronID = " << patronID << '\n';
+        list("Borrowed", held);
+        list("Reserved", reserved);
+        output << '\n';
+    }
+
+    static void PrintNothingToReturn(int patronID, OutputSink &output) { output << "Patron " << patronID << " has no books to return" << '\n'; }
+
+    void CancelReservation(int patronID, int bookID, OutputSink &output)
+    { // Removes the patron from the book's waiting list in O(log r).
+
+        auto timer = timeCall(TimedCall::CancelReservation);
+        auto guard = readLock();
+        Book *book = catalog.find(bookID);
+
+        if (book == nullptr)
+        {
+            output << "Book " << bookID << " not found in the Library" << '\n';
+            return;
+        }
+        auto bookGuard = lockBook(bookID);
+        if (log)
+            log->values(WriteAheadLog::Op::CancelReservation, {patronID, bookID});
+
+        if (book->reservationHeap.cancel(patronID))
+        {
+            unindexBook(patronID, bookID, &PatronBooks::reserved);
+            bookChanged(bookID);
+            output << "Reservation made by Patron " << patronID << " for Book " << bookID << " has been cancelled!" << '\n';
+        }
+        else
+            output << "Patron " << patronID << " has no reservation for Book " << bookID << '\n';
+    }
+
+    void UpdatePriority(int patronID, int bookID, int patronPriority, OutputSink &output)
+    { // Moves the patron's reservation to a new priority; ties still go to the earlier reservation.
+
+        auto timer = timeCall(TimedCall::UpdatePriority);
+        auto guard = readLock();
+        Book *book = catalog.find(bookID);
+
+        if (book == nullptr)
+        {
+            output << "Book " << bookID << " not found in the Library" << '\n';
+            return;
+        }
+        auto bookGuard = lockBook(bookID);
+        if (log)
+            log->values(WriteAheadLog::Op::UpdatePriority, {patronID, bookID, patronPriority});
+
+        if (book->reservationHeap.update(patronID, patronPriority))
+        {
+            bookChanged(bookID);
+            output << "Reservation made by Patron " << patronID << " for Book " << bookID << " now has priority " << patronPriority << '\n';
+        }
+        else
+            output << "Patron " << patronID << " has no reservation for Book " << bookID << '\n';
+    }
+
+    void PrintBook(int bookID, OutputSink &output)
+    {
+        auto timer = timeCall(TimedCall::PrintBook);
+        auto guard = readLock();
+        Book *book = catalog.find(bookID);
+
+        if (book)
+        {
+            printBookDetails(*book, output);
+        }
+        else
+        {
+            output << "Book " << bookID << " not found in the Library" << '\n';
+        }
+    }
+
+    void PrintBook(const Cursor &it, OutputSink &output) { PrintBook(it.book(), output); } // Without looking the book up again.
+
+    void PrintBook(const Book &book, OutputSink &output)
+    {
+        auto guard = readLock();
+        printBookDetails(book, output);
+    }
+
+    void FindByAuthor(std::string_view authorName, OutputSink &output)
+    {
+        if (PrintBooksByAuthor(authorName, output) == 0)
+            PrintNoMatches("by", authorName, output);
+    }
+
+    void FindByTitlePrefix(std::string_view prefix, OutputSink &output)
+    {
+        auto timer = timeCall(TimedCall::FindByTitlePrefix);
+        auto guard = readLock();
+        int found = 0;
+        forEachTitlePrefix(prefix, [&](const Book &book)
+                           {
+            printBookDetails(book, output);
+            ++found; });
+        if (found == 0)
+            PrintNoMatches("with a title starting with", prefix, output);
+    }
+
+    int PrintBooksByAuthor(std::string_view authorName, OutputSink &output)
+    { // Prints every book by exactly this author, in bookID order, in O(log n + k). Returns k.
+
+        auto timer = timeCall(TimedCall::FindByAuthor);
+        auto guard = readLock();
+        ensureNameIndexes();
+        int found = 0;
+        for (auto it = authorIndex.lower_bound(authorName); it != authorIndex.end() && (*it)->authorName == authorName; ++it, ++found)
+            printBookDetails(**it, output);
+        return found;
+    }
+
+    std::vector<const Book *> BooksWithTitlePrefix(std::string_view prefix) const
+    { // FindByTitlePrefix's matches, in title order. They stay valid until the next DeleteBook.
+
+        auto guard = readLock();
+        std::vector<const Book *> books;
+        forEachTitlePrefix(prefix, [&](const Book &book)
+                           { books.push_back(&book); });
+        return books;
+    }
+
+    static void PrintNoMatches(std::string_view what, std::string_view name, OutputSink &output) { output << "No books " << what << " \"" << name << "\" in the Library" << '\n'; }
+
+    void PrintBooks(int bookID1, int bookID2, OutputSink &output)
+    { // Prints every book with an ID in [bookID1, bookID2] in O(log n + k), or O(1) for a repeat.
+      // Ranges too large for the cache are printed straight out.
+
+        auto timer = timeCall(TimedCall::PrintBooks);
+        auto guard = readLock();
+        auto print = [&](OutputSink &to)
+        {
+            for (Cursor it = LowerBound(bookID1); it.valid() && it.bookID() <= bookID2; it.next())
+                printBookDetails(it.book(), to);
+            return QueryCache::Interval{bookID1, bookID2};
+        };
+        std::size_t books = bookID1 > bookID2 ? 0 : catalog.countBelow(bookID2, true) - catalog.countBelow(bookID1, false);
+        if (books == 0)
+            return;
+        cachedQuery(QueryCache::PrintBooks, bookID1, bookID2, books * kMinBookDetailsBytes, output, print);
+    }
+
+    void DeleteBook(int bookID, OutputSink &output)
+    {
+        auto timer = timeCall(TimedCall::DeleteBook);
+        auto guard = writeLock();
+        Book *book = catalog.find(bookID);
+
+        if (book == nullptr)
+            return;
+        if (log)
+            log->values(WriteAheadLog::Op::DeleteBook, {bookID});
+
+        retireBook(*book, output);
+        deleteBook(book);
+    }
+
+    void DeleteRange(int bookID1, int bookID2, OutputSink &output)
+    { // DeleteBook for every book with an ID in [bookID1, bookID2], in ID order and with the same messages.
+      // The range is split out of the index whole and the two sides joined back, so the tree work is
+      // O(log n) rather than a delete and its fixup per book; the rest is O(1) per book removed.
+
+        auto timer = timeCall(TimedCall::DeleteRange);
+        auto guard = writeLock();
+        Cursor it = LowerBound(bookID1);
+        if (!it.valid() || it.bookID() > bookID2)
+            return;
+        if (log)
+            log->values(WriteAheadLog::Op::DeleteRange, {bookID1, bookID2});
+
+        for (; it.valid() && it.bookID() <= bookID2; it.next())
+            retireBook(it.book(), output);
+        catalog.eraseRange(bookID1, bookID2, [this](Book *book)
+                           { destroyBook(book); });
+        if (catalog.empty())
+            snapshotFile.reset(); // No title points into a loaded image any more.
+        booksChanged(bookID1, bookID2);
+    }
+
+    bool MergeLibrary(BasicGatorLibrary &other)
+    { // Moves every book of other, with its loans and reservations, into this library and leaves other
+      // empty. Their bookIDs must not interleave: all of other's must lie below all of this library's,
+      // or above. Otherwise nothing moves and false comes back.
+      //
+      // Neither library may have a write-ahead log attached, or false comes back too: the joined
+      // tree's shape (and so ColorFlipCount) depends on how other's tree was built, which no log
+      // record can reproduce, so a replay could not rebuild the same catalog.
+      //
+      // The indexes are joined in O(log n), and other's book slots and name storage are taken over
+      // in place rather than copied. Beyond that the merge costs one step per patron entry moved; a
+      // name-index insert per book once FindByAuthor or FindByTitlePrefix has built those indexes;
+      // and an O(log n) version update per book while versions are kept.
+
+        auto timer = timeCall(TimedCall::MergeLibrary);
+        if (&other == this || log != nullptr || other.log != nullptr)
+            return false;
+        // Locked in address order, so a.MergeLibrary(b) racing b.MergeLibrary(a) cannot deadlock.
+        bool thisFirst = std::less<const BasicGatorLibrary *>()(this, &other);
+        auto firstGuard = (thisFirst ? this : &other)->writeLock();
+        auto secondGuard = (thisFirst ? &other : this)->writeLock();
+        if (other.catalog.empty())
+            return true;
+        int low = other.catalog.first().bookID();
+        int high = other.catalog.last().bookID();
+        if (!catalog.empty() && high >= catalog.first().bookID() && low <= catalog.last().bookID())
+            return false;
+
+        if (nameIndexed.load(std::memory_order_relaxed))
+            for (Cursor it = other.First(); it.valid(); it.next())
+            {
+                Book *book = const_cast<Book *>(&it.book());
+                authorIndex.insert(book);
+                titleIndex.insert(book);
+            }
+        other.authorIndex.clear();
+        other.titleIndex.clear();
+        for (auto &[patronID, theirs] : other.patrons)
+        {
+            PatronBooks &mine = patrons[patronID];
+            spliceIDs(mine.held, theirs.held);
+            spliceIDs(mine.reserved, theirs.reserved);
+        }
+        other.patrons.clear();
+
+        catalog.join(other.catalog);
+        bookPool.adopt(other.bookPool);
+        titles.adopt(other.titles);
+        authors.adopt(other.authors);
+        adoptedTexts.insert(adoptedTexts.end(), other.adoptedTexts.begin(), other.adoptedTexts.end());
+        other.adoptedTexts.clear();
+        if (other.snapshotFile && snapshotFile) // Both sides' titles may point into a loaded image: keep both.
+            snapshotFile = std::make_shared<std::pair<std::shared_ptr<const void>, std::shared_ptr<const void>>>(snapshotFile, other.snapshotFile);
+        else if (other.snapshotFile)
+            snapshotFile = other.snapshotFile;
+        other.snapshotFile.reset();
+        if (other.reservationSequence.load() > reservationSequence.load())
+            reservationSequence.store(other.reservationSequence.load());
+
+        other.allBooksChanged();
+        booksChanged(low, high);
+        return true;
+    }
+
+    void FindClosestBook(int targetID, OutputSink &output)
+    { // Prints the book closest to targetID; on a tie both neighbours are printed in ID order.
+      // The result depends on the books from the closest below targetID to the closest above.
+
+        auto timer = timeCall(TimedCall::FindClosestBook);
+        auto guard = readLock();
+        auto find = [&](OutputSink &to)
+        {
+            if (catalog.empty())
+            {
+                to << "Library is empty." << '\n';
+                return QueryCache::Interval{QueryCache::kNoLow, QueryCache::kNoHigh};
+            }
+
+            Cursor after = LowerBound(targetID);
+            if (after.valid() && after.bookID() == targetID)
+            {
+                printBookDetails(after.book(), to);
+                return QueryCache::Interval{targetID, targetID};
+            }
+
+            Cursor before = after.valid() ? Cursor(after).prev() : Last();
+            if (!before.valid() || !after.valid())
+            {
+                printBookDetails((before.valid() ? before : after).book(), to);
+                return before.valid() ? QueryCache::Interval{before.bookID(), QueryCache::kNoHigh}
+                                      : QueryCache::Interval{QueryCache::kNoLow, after.bookID()};
+            }
+
+            long long below = static_cast<long long>(targetID) - before.bookID();
+            long long above = static_cast<long long>(after.bookID()) - targetID;
+            if (below <= above)
+                printBookDetails(before.book(), to);
+            if (above <= below)
+                printBookDetails(after.book(), to);
+            return QueryCache::Interval{before.bookID(), after.bookID()};
+        };
+        cachedQuery(QueryCache::FindClosestBook, targetID, 0, kMinBookDetailsBytes, output, find);
+    }
+
+    int Size() const
+    {
+        auto guard = readLock();
+        return catalog.size();
+    }
+
+    void RecordReservationTimes(bool enabled) { recordReservationTimes = enabled; } // Stamp new reservations with time(0).
+
+    void SetQueryCacheBudget(std::size_t bytes)
+    { // Memory for cached PrintBooks and FindClosestBook results (8 MB by default); 0 turns the cache off.
+
+        auto cacheGuard = lockCache();
+        queryCache.setBudget(bytes);
+    }
+
+    void EnableVersions()
+    { // Starts publishing a CatalogVersion after every change, for Pin(). The first is built here in
+      // O(n); from then on each change to a book adds O(log n) for the path it copies.
+
+        auto guard = writeLock();
+        if (versioned)
+            return;
+        versioned = true;
+        republish();
+    }
+
+    CatalogVersion Pin() const
+    { // The latest version (empty before EnableVersions). It stays as it is for as long as the copy
+      // returned, or a copy of it, is kept. Any thread may call this, in either mode, at any time.
+
+        std::lock_guard<std::mutex> pinGuard(pinMutex);
+        return current;
+    }
+
+    void AttachLog(WriteAheadLog *wal)
+    { // Appends every later mutation to wal (null stops logging). Attach after replaying the log.
+
+        auto guard = writeLock();
+        log = wal;
+    }
+
+    std::uint64_t SnapshotLogSequence() const { return snapshotLogSequence; } // Log records before this are in the snapshot.
+
+    bool ApplyLogRecord(const WriteAheadLog::Record &record)
+    { // Replays one record read back from a write-ahead log. Messages are discarded; the
+      // original run already printed them. Returns false if a logged snapshot cannot be reloaded.
+
+        OutputSink discard(-1, 1 << 12);
+        const int *v = record.values;
+        switch (record.op)
+        {
+        case WriteAheadLog::Op::InsertBook:
+            InsertBook(v[0], record.strings[0], record.strings[1], true, -1); // Names are copied out of the log.
+            break;
+        case WriteAheadLog::Op::BulkLoad:
+            BulkLoad(record.books.begin(), record.books.end());
+            break;
+        case WriteAheadLog::Op::BorrowBook:
+            BorrowBook(v[0], v[1], v[2], discard);
+            break;
+        case WriteAheadLog::Op::ReturnBook:
+            ReturnBook(v[0], v[1], discard);
+            break;
+        case WriteAheadLog::Op::DeleteBook:
+            DeleteBook(v[0], discard);
+            break;
+        case WriteAheadLog::Op::DeleteRange:
+            DeleteRange(v[0], v[1], discard);
+            break;
+        case WriteAheadLog::Op::CancelReservation:
+            CancelReservation(v[0], v[1], discard);
+            break;
+        case WriteAheadLog::Op::UpdatePriority:
+            UpdatePriority(v[0], v[1], v[2], discard);
+            break;
+        case WriteAheadLog::Op::ReturnAll:
+            ReturnHeldBooks(v[0], discard);
+            break;
+        case WriteAheadLog::Op::LoadSnapshot:
+            return LoadSnapshot(std::string(record.strings[0]), nullptr, &record.image); // Fails if the path was saved over since.
+        }
+        return true;
+    }
+
+    int ColorFlips() const
+    {
+        auto guard = readLock();
+        return catalog.colorFlips();
+    }
+
+    int BookCount(int bookID1, int bookID2)
+    { // Number of books with IDs in [bookID1, bookID2], in O(log n).
+
+        auto timer = timeCall(TimedCall::CountBooks);
+        auto guard = readLock();
+        return bookID1 > bookID2 ? 0 : catalog.countBelow(bookID2, true) - catalog.countBelow(bookID1, false);
+    }
+
+    int Rank(int bookID)
+    { // 1-based position of the book in bookID order, or 0 if it is not in the library.
+
+        auto timer = timeCall(TimedCall::RankOf);
+        auto guard = readLock();
+        return catalog.find(bookID) == nullptr ? 0 : catalog.countBelow(bookID, false) + 1;
+    }
+
+    void CountBooks(int bookID1, int bookID2, OutputSink &output)
+    {
+        PrintBookCount(BookCount(bookID1, bookID2), output);
+    }
+
+    void SelectBook(int rank, OutputSink &output)
+    { // Prints the book with the rank-th smallest ID (1-based).
+
+        auto timer = timeCall(TimedCall::SelectBook);
+        auto guard = readLock();
+        Book *book = rank >= 1 ? catalog.select(rank) : nullptr;
+        if (book)
+            printBookDetails(*book, output);
+        else
+            output << "No book at rank " << rank << " in the Library" << '\n';
+    }
+
+    void RankOf(int bookID, OutputSink &output)
+    {
+        PrintRank(bookID, Rank(bookID), output);
+    }
+
+    static void PrintBookCount(int count, OutputSink &output) { output << "Book Count: " << count << '\n'; }
+
+    static void PrintRank(int bookID, int rank, OutputSink &output)
+    { // Formats a RankOf result; rank 0 means the book is missing.
+
+        if (rank == 0)
+            output << "Book " << bookID << " not found in the Library" << '\n';
+        else
+            output << "Rank of Book " << bookID << ": " << rank << '\n';
+    }
+
+    void ColorFlipCount(OutputSink &output)
+    { // The recolor tally of single-book inserts and deletes (see RBTree). A BulkLoad into an empty
+      // library, DeleteRange and MergeLibrary restructure the tree without adding to it, and a merge
+      // does not carry over the other library's tally.
+
+        auto guard = readLock();
+        output << catalog.colorFlips();
+    }
+
+    void Stats(OutputSink &output)
+    { // Prints the index's shape and, when instrumentation is compiled in, its work counters and
+      // per-call latencies. The shape takes an O(n) walk.
+
+        auto guard = readLock();
+        TreeShape shape = catalog.shape();
+        output << "Stats:\n";
+        output << "Index = " << Index::kName << ", Books = " << shape.entries << ", Nodes = " << shape.nodes
+               << ", Height = " << shape.height << ", Black Height = " << shape.blackHeight
+               << ", Height Bound = " << heightBound(shape.entries) << '\n';
+        if (!kStatsEnabled)
+        {
+            output << "Counters = off (built with GATOR_STATS=0)\n\n";
+            return;
+        }
+        const TreeCounters &counters = catalog.counters();
+        std::uint64_t finds = counters.finds.get();
+        std::uint64_t meanDepth = finds == 0 ? 0 : counters.findDepth.get() * 100 / finds;
+        output << "Rotations = " << counters.rotations.get() << ", Recolors = " << counters.recolors.get()
+               << ", Fixup Iterations = " << counters.fixupIterations.get() << ", Splits = " << counters.splits.get()
+               << ", Merges = " << counters.merges.get() << '\n';
+        output << "Finds = " << finds << ", Mean Find Depth = " << meanDepth / 100 << '.' << (meanDepth % 100 < 10 ? "0" : "")
+               << meanDepth % 100 << ", Max Find Depth = " << counters.maxFindDepth.get() << '\n';
+        {
+            auto cacheGuard = lockCache();
+            output << "Query Cache: entries = " << queryCache.size() << ", bytes = " << queryCache.memoryUsed()
+                   << ", hits = " << queryCache.hits() << ", misses = " << queryCache.misses()
+                   << ", evictions = " << queryCache.evictions() << '\n';
+        }
+        for (int call = 0; call < static_cast<int>(TimedCall::Count); ++call)
+        {
+            const LatencyHistogram &latency = latencies[call];
+            if (latency.count() == 0)
+                continue;
+            output << timedCallName(call) << ": count = " << latency.count() << ", p50 = " << latency.percentile(50)
+                   << " ns, p99 = " << latency.percentile(99) << " ns, max = " << latency.max() << " ns\n";
+        }
+        output << '\n';
+    }
+
+    void StatsJson(OutputSink &output)
+    { // Stats() as one JSON object, for tools to collect.
+
+        auto guard = readLock();
+        TreeShape shape = catalog.shape();
+        const TreeCounters &counters = catalog.counters();
+        output << "{\"index\": \"" << Index::kName << "\", \"books\": " << shape.entries << ", \"nodes\": " << shape.nodes
+               << ", \"height\": " << shape.height << ", \"blackHeight\": " << shape.blackHeight
+               << ", \"heightBound\": " << heightBound(shape.entries) << ", \"colorFlipCount\": " << catalog.colorFlips()
+               << ", \"instrumented\": " << (kStatsEnabled ? "true" : "false");
+        if (kStatsEnabled)
+        {
+            output << ", \"rotations\": " << counters.rotations.get() << ", \"recolors\": " << counters.recolors.get()
+                   << ", \"fixupIterations\": " << counters.fixupIterations.get() << ", \"splits\": " << counters.splits.get()
+                   << ", \"merges\": " << counters.merges.get()
+                   << ", \"finds\": " << counters.finds.get() << ", \"findDepthTotal\": " << counters.findDepth.get()
+                   << ", \"maxFindDepth\": " << counters.maxFindDepth.get();
+            {
+                auto cacheGuard = lockCache();
+                output << ", \"queryCache\": {\"entries\": " << queryCache.size() << ", \"bytes\": " << queryCache.memoryUsed()
+                       << ", \"hits\": " << queryCache.hits() << ", \"misses\": " << queryCache.misses()
+                       << ", \"evictions\": " << queryCache.evictions() << '}';
+            }
+            output << ", \"latencyNs\": {";
+            const char *separator = "";
+            for (int call = 0; call < static_cast<int>(TimedCall::Count); ++call)
+            {
+                const LatencyHistogram &latency = latencies[call];
+                if (latency.count() == 0)
+                    continue;
+                output << separator << '"' << timedCallName(call) << "\": {\"count\": " << latency.count()
+                       << ", \"mean\": " << latency.mean() << ", \"p50\": " << latency.percentile(50)
+                       << ", \"p90\": " << latency.percentile(90) << ", \"p99\": " << latency.percentile(99)
+                       << ", \"p999\": " << latency.percentile(99.9) << ", \"max\": " << latency.max() << '}';
+                separator = ", ";
+            }
+            output << '}';
+        }
+        output << "}\n";
+    }
+};
+
+using GatorLibrary = BasicGatorLibrary<RBTreeIndex>;
+using BTreeGatorLibrary = BasicGatorLibrary<BTreeIndex>;
+
+#endif
@@ -0,0 +1,199 @@
+#ifndef OUTPUT_SINK_H
+#define OUTPUT_SINK_H
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <fcntl.h>
+#include <unistd.h>
+
+// Buffered writer for command output. Text accumulates in one reusable
+// buffer and reaches the file descriptor only when the buffer fills up or
+// flush() is called, so there is no syscall per line. Integers are formatted
+// with to_chars instead of going through iostreams.
+//
+// A default-constructed sink has no file descriptor and captures everything in
+// memory instead; its buffer grows as needed and contents() returns the text.
+//
+// A sink can also hand its full buffers to a SinkDrain, which writes them out
+// on another thread and gives back an empty buffer (see BackgroundWriter in
+// command_pipeline.h), so formatting never waits on the write.
+class SinkDrain
+{
+public:
+    // Takes a full buffer of `size` bytes meant for `fd` and returns an empty
+    // one of at least `capacity` bytes.
+    virtual std::unique_ptr<char[]> exchange(int fd, std::unique_ptr<char[]> full, std::size_t size, std::size_t capacity) = 0;
+
+protected:
+    ~SinkDrain() = default;
+};
+
+inline void writeFully(int fd, const char *data, std::size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t written = ::write(fd, data, size);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return; // Nowhere to report a failed write; drop the output like an ofstream would.
+        }
+        data += written;
+        size -= static_cast<std::size_t>(written);
+    }
+}
+
+class OutputSink
+{
+private:
+    std::unique_ptr<char[]> buffer;
+    std::size_t capacity;
+    std::size_t used = 0;
+    int fd;
+    bool ownsFd;
+    bool capturing = false;
+    SinkDrain *handoff = nullptr;
+
+    void grow(std::size_t needed)
+    {
+        std::size_t larger = capacity;
+        while (larger - used < needed)
+            larger *= 2;
+        std::unique_ptr<char[]> replacement(new char[larger]);
+        std::memcpy(replacement.get(), buffer.get(), used);
+        buffer = std::move(replacement);
+        capacity = larger;
+    }
+
+    void drain(const char *data, std::size_t size)
+    {
+        if (handoff == nullptr)
+        {
+            writeFully(fd, data, size);
+            return;
+        }
+        while (size > 0)
+        { // Through the buffer in pieces, so it stays in order with what the drain already holds.
+            std::size_t piece = std::min(size, capacity);
+            std::memcpy(buffer.get(), data, piece);
+            buffer = handoff->exchange(fd, std::move(buffer), piece, capacity);
+            data += piece;
+            size -= piece;
+        }
+    }
+
+public:
+    static constexpr std::size_t kDefaultCapacity = 1 << 20;
+
+    explicit OutputSink(int fd, std::size_t capacity = kDefaultCapacity)
+        : buffer(new char[capacity]), capacity(capacity), fd(fd), ownsFd(false)
+    {
+    }
+
+    explicit OutputSink(const std::string &filename, std::size_t capacity = kDefaultCapacity)
+        : buffer(new char[capacity]), capacity(capacity), fd(::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644)), ownsFd(true)
+    {
+    }
+
+    OutputSink()
+        : buffer(new char[4096]), capacity(4096), fd(-1), ownsFd(false), capturing(true)
+    {
+    }
+
+    OutputSink(const OutputSink &) = delete;
+    OutputSink &operator=(const OutputSink &) = delete;
+
+    ~OutputSink()
+    {
+        flush();
+        if (ownsFd && fd >= 0)
+            ::close(fd);
+    }
+
+    bool isOpen() const { return fd >= 0; }
+
+    std::string_view contents() const { return std::string_view(buffer.get(), used); }
+    std::size_t size() const { return used; }
+
+    void clear() { used = 0; }
+
+    void flush()
+    {
+        if (capturing)
+            return;
+        if (used > 0 && fd >= 0)
+        {
+            if (handoff)
+                buffer = handoff->exchange(fd, std::move(buffer), used, capacity);
+            else
+                writeFully(fd, buffer.get(), used);
+        }
+        used = 0;
+    }
+
+    void drainThrough(SinkDrain *drain)
+    { // Flushes, then sends full buffers to `drain` from now on (or writes them here again, for nullptr).
+
+        flush();
+        handoff = drain;
+    }
+
+    void write(const char *data, std::size_t size)
+    {
+        if (size > capacity - used)
+        {
+            if (capturing)
+                grow(size);
+            else
+                flush();
+            if (size > capacity - used)
+            { // Too big to ever fit; send it straight through.
+                if (fd >= 0)
+                    drain(data, size);
+                return;
+            }
+        }
+        std::memcpy(buffer.get() + used, data, size);
+        used += size;
+    }
+
+    OutputSink &operator<<(std::string_view text)
+    {
+        write(text.data(), text.size());
+        return *this;
+    }
+
+    OutputSink &operator<<(const char *text) { return *this << std::string_view(text); }
+
+    OutputSink &operator<<(char c)
+    {
+        if (used == capacity)
+        {
+            if (capturing)
+                grow(1);
+            else
+                flush();
+        }
+        buffer[used++] = c;
+        return *this;
+    }
+
+    template <typename Integer, typename = std::enable_if_t<std::is_integral_v<Integer> && !std::is_same_v<Integer, char> && !std::is_same_v<Integer, bool>>>
+    OutputSink &operator<<(Integer value)
+    {
+        char digits[24];
+        char *end = std::to_chars(digits, digits + sizeof(digits), value).ptr;
+        write(digits, end - digits);
+        return *this;
+    }
+};
+
+#endif
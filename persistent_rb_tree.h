@@ -0,0 +1,284 @@
+#ifndef PERSISTENT_RB_TREE_H
+#define PERSISTENT_RB_TREE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
+#include "rb_tree.h"
+
+// Persistent red-black tree: an update never changes the tree it is applied
+// to, it builds a new version that shares every untouched subtree with the
+// old one. Only the O(log n) nodes on the path to the change are copied.
+// Nodes are immutable once built and reference counted, so a version stays
+// readable for as long as some handle holds it, from any thread and without
+// locks, and each node is freed with the last version that contains it.
+//
+// Insertion is Okasaki's, deletion is Kahrs': both rebuild the search path
+// bottom-up with the usual local rebalancing cases, so no node is ever
+// changed in place. Keys are unique; assign() replaces the value of a key
+// already present. Nodes carry subtree sizes.
+//
+// A handle is cheap to copy (one count increment) and copies are independent.
+// One handle must not be updated by two threads at once.
+template <typename Key, typename Value, typename Compare = std::less<Key>>
+class PersistentRBTree
+{
+private:
+    struct Node;
+
+    class Link
+    { // Counted reference to a node.
+
+    private:
+        Node *node = nullptr;
+
+    public:
+        Link() = default;
+        explicit Link(Node *fresh) : node(fresh) {} // Takes over a new node, whose count starts at 1.
+        Link(const Link &other) : node(other.node)
+        {
+            if (node)
+                node->refs.fetch_add(1, std::memory_order_relaxed);
+        }
+        Link(Link &&other) noexcept : node(other.node) { other.node = nullptr; }
+        Link &operator=(Link other) noexcept
+        {
+            std::swap(node, other.node);
+            return *this;
+        }
+        ~Link()
+        {
+            if (node && node->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                delete node; // Its children's links go with it, recursively down to shared subtrees.
+        }
+
+        const Node *get() const { return node; }
+        const Node &operator*() const { return *node; }
+        const Node *operator->() const { return node; }
+        explicit operator bool() const { return node != nullptr; }
+    };
+
+    struct Node
+    {
+        Link left;
+        Link right;
+        Key key;
+        Value value;
+        int size; // Nodes in this subtree.
+        Color color;
+        std::atomic<std::uint32_t> refs{1};
+    };
+
+    Link rootLink;
+    Compare less;
+
+    static bool isRed(const Link &t) { return t && t->color == RED; }
+    static int sizeOf(const Link &t) { return t ? t->size : 0; }
+
+    static Link make(Color color, Link left, const Key &key, const Value &value, Link right)
+    {
+        int size = 1 + sizeOf(left) + sizeOf(right);
+        return Link(new Node{std::move(left), std::move(right), key, value, size, color});
+    }
+
+    static Link make(Color color, Link left, const Node &entry, Link right) { return make(color, std::move(left), entry.key, entry.value, std::move(right)); }
+
+    static Link painted(const Link &t, Color color) { return t->color == color ? t : make(color, t->left, *t, t->right); }
+
+    static Link balance(Link a, const Node &x, Link b)
+    { // A black node with children a and b, rebuilt as a red one over two black ones if either child
+      // is red with a red child, or both are red (Kahrs' version of Okasaki's four cases).
+
+        if (isRed(a) && isRed(b))
+            return make(RED, painted(a, BLACK), x, painted(b, BLACK));
+        if (isRed(a) && isRed(a->left))
+            return make(RED, painted(a->left, BLACK), *a, make(BLACK, a->right, x, std::move(b)));
+        if (isRed(a) && isRed(a->right))
+            return make(RED, make(BLACK, a->left, *a, a->right->left), *a->right, make(BLACK, a->right->right, x, std::move(b)));
+        if (isRed(b) && isRed(b->right))
+            return make(RED, make(BLACK, std::move(a), x, b->left), *b, painted(b->right, BLACK));
+        if (isRed(b) && isRed(b->left))
+            return make(RED, make(BLACK, std::move(a), x, b->left->left), *b->left, make(BLACK, b->left->right, *b, b->right));
+        return make(BLACK, std::move(a), x, std::move(b));
+    }
+
+    Link insert(const Link &t, const Key &key, const Value &value) const
+    {
+        if (!t)
+            return make(RED, Link(), key, value, Link());
+        if (less(key, t->key))
+        {
+            Link left = insert(t->left, key, value);
+            return t->color == BLACK ? balance(std::move(left), *t, t->right) : make(RED, std::move(left), *t, t->right);
+        }
+        if (less(t->key, key))
+        {
+            Link right = insert(t->right, key, value);
+            return t->color == BLACK ? balance(t->left, *t, std::move(right)) : make(RED, t->left, *t, std::move(right));
+        }
+        return make(t->color, t->left, key, value, t->right);
+    }
+
+    static Link leaned(const Link &t)
+    { // A black tree with its root made red, one black level shorter (Kahrs' sub1).
+
+        return make(RED, t->left, *t, t->right);
+    }
+
+    static Link balanceLeft(Link left, const Node &x, const Link &right)
+    { // Rebuilds a node whose left subtree came out one black level short.
+
+        if (isRed(left))
+            return make(RED, painted(left, BLACK), x, right);
+        if (right->color == BLACK)
+            return balance(std::move(left), x, leaned(right));
+        const Link &inner = right->left; // Black, as a red node's children are.
+        return make(RED, make(BLACK, std::move(left), x, inner->left), *inner, balance(inner->right, *right, leaned(right->right)));
+    }
+
+    static Link balanceRight(const Link &left, const Node &x, Link right)
+    { // Rebuilds a node whose right subtree came out one black level short.
+
+        if (isRed(right))
+            return make(RED, left, x, painted(right, BLACK));
+        if (left->color == BLACK)
+            return balance(leaned(left), x, std::move(right));
+        const Link &inner = left->right;
+        return make(RED, balance(leaned(left->left), *left, inner->left), *inner, make(BLACK, inner->right, x, std::move(right)));
+    }
+
+    static Link fuse(const Link &a, const Link &b)
+    { // Joins the two subtrees of a removed node, all of a's keys before b's (Kahrs' app).
+
+        if (!a)
+            return b;
+        if (!b)
+            return a;
+        if (isRed(a) && isRed(b))
+        {
+            Link middle = fuse(a->right, b->left);
+            if (isRed(middle))
+                return make(RED, make(RED, a->left, *a, middle->left), *middle, make(RED, middle->right, *b, b->right));
+            return make(RED, a->left, *a, make(RED, std::move(middle), *b, b->right));
+        }
+        if (!isRed(a) && !isRed(b))
+        {
+            Link middle = fuse(a->right, b->left);
+            if (isRed(middle))
+                return make(RED, make(BLACK, a->left, *a, middle->left), *middle, make(BLACK, middle->right, *b, b->right));
+            return balanceLeft(a->left, *a, make(BLACK, std::move(middle), *b, b->right));
+        }
+        if (isRed(b))
+            return make(RED, fuse(a, b->left), *b, b->right);
+        return make(RED, a->left, *a, fuse(a->right, b));
+    }
+
+    Link remove(const Link &t, const Key &key) const
+    { // t without key, which must be present. A black t comes back one black level shorter.
+
+        if (less(key, t->key))
+        {
+            if (t->left->color == BLACK)
+                return balanceLeft(remove(t->left, key), *t, t->right);
+            return make(RED, remove(t->left, key), *t, t->right);
+        }
+        if (less(t->key, key))
+        {
+            if (t->right->color == BLACK)
+                return balanceRight(t->left, *t, remove(t->right, key));
+            return make(RED, t->left, *t, remove(t->right, key));
+        }
+        return fuse(t->left, t->right);
+    }
+
+    static Link build(std::vector<std::pair<Key, Value>> &items, long lo, long hi, int depth, int redDepth)
+    { // Builds items[lo..hi] into a balanced subtree. Only the bottom level is red, so every path has the same black height.
+
+        if (lo > hi)
+            return Link();
+        long mid = lo + (hi - lo) / 2;
+        Link left = build(items, lo, mid - 1, depth + 1, redDepth);
+        Link right = build(items, mid + 1, hi, depth + 1, redDepth);
+        return make(depth == redDepth && depth > 0 ? RED : BLACK, std::move(left), items[mid].first, items[mid].second, std::move(right));
+    }
+
+    template <typename Visit>
+    void visitRange(const Node *node, const Key &low, const Key &high, Visit &visit) const
+    {
+        while (node != nullptr)
+        {
+            if (less(node->key, low))
+                node = node->right.get();
+            else if (less(high, node->key))
+                node = node->left.get();
+            else
+            {
+                visitRange(node->left.get(), low, high, visit);
+                visit(node->key, node->value);
+                node = node->right.get();
+            }
+        }
+    }
+
+public:
+    PersistentRBTree() = default;
+
+    bool empty() const { return !rootLink; }
+    int size() const { return sizeOf(rootLink); }
+
+    const Value *find(const Key &key) const
+    {
+        const Node *node = rootLink.get();
+        while (node != nullptr)
+        {
+            if (less(key, node->key))
+                node = node->left.get();
+            else if (less(node->key, key))
+                node = node->right.get();
+            else
+                return &node->value;
+        }
+        return nullptr;
+    }
+
+    template <typename Visit>
+    void forEach(const Key &low, const Key &high, Visit visit) const
+    { // Calls visit(key, value) for every key in [low, high], in order, in O(log n + k).
+
+        visitRange(rootLink.get(), low, high, visit);
+    }
+
+    void assign(const Key &key, const Value &value)
+    { // Makes this handle a version with key mapped to value. O(log n) new nodes.
+
+        rootLink = painted(insert(rootLink, key, value), BLACK);
+    }
+
+    bool erase(const Key &key)
+    { // Makes this handle a version without key, if it has it. O(log n) new nodes.
+
+        if (find(key) == nullptr)
+            return false;
+        Link root = remove(rootLink, key);
+        rootLink = root ? painted(root, BLACK) : Link();
+        return true;
+    }
+
+    void clear() { rootLink = Link(); }
+
+    static PersistentRBTree fromSorted(std::vector<std::pair<Key, Value>> &items)
+    { // A version holding items, which must be in strictly increasing key order, built in O(n).
+
+        int redDepth = 0; // Depth of the bottom level; every null link sits at redDepth or redDepth + 1.
+        while ((std::size_t(2) << redDepth) <= items.size())
+            ++redDepth;
+        PersistentRBTree tree;
+        tree.rootLink = build(items, 0, static_cast<long>(items.size()) - 1, 0, redDepth);
+        return tree;
+    }
+};
+
+#endif
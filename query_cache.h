@@ -0,0 +1,263 @@
+#ifndef QUERY_CACHE_H
+#define QUERY_CACHE_H
+
+#include <cstddef>
+#include <functional>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "output_sink.h"
+#include "rb_tree.h"
+#include "slab_pool.h"
+#include "stats.h"
+
+// Formatted results of read-only range queries, kept until something they
+// depend on changes. Every entry carries the closed interval of bookIDs its
+// result depends on: any insert or delete of an ID in the interval, or any
+// change to a book with such an ID, evicts it, and nothing else does. The
+// intervals live in an interval tree (an RBTree by low end, augmented with
+// the largest high end below each node), so an invalidation costs
+// O(log n + evicted) whatever the number of cached queries.
+//
+// A query is only cached the second time it misses within a short while, so
+// one-off queries cost a hash probe rather than a copy of their output. Least
+// recently used entries are dropped once the text held passes the byte
+// budget. A result changed while it was being computed is not stored: callers
+// read epoch() before computing and pass it back to store().
+//
+// Not synchronized; the library guards it with its own mutex.
+class QueryCache
+{
+public:
+    enum Kind : std::uint8_t
+    {
+        PrintBooks,
+        FindClosestBook
+    };
+
+    struct Interval
+    { // Closed range of bookIDs a result depends on.
+        long long low;
+        long long high;
+    };
+
+    static constexpr long long kNoLow = std::numeric_limits<long long>::min(); // Open ends of an interval.
+    static constexpr long long kNoHigh = std::numeric_limits<long long>::max();
+    static constexpr std::size_t kDefaultBudget = 8 << 20;
+    static constexpr std::size_t kRecentMisses = 4096; // Slots remembering queries that missed once.
+
+private:
+    struct Query
+    {
+        Kind kind;
+        int first;
+        int second; // Unused (zero) for FindClosestBook.
+
+        bool operator==(const Query &other) const { return kind == other.kind && first == other.first && second == other.second; }
+    };
+
+    struct QueryHash
+    {
+        std::size_t operator()(const Query &query) const
+        {
+            std::uint64_t packed = static_cast<std::uint64_t>(static_cast<std::uint32_t>(query.first)) << 32 | static_cast<std::uint32_t>(query.second);
+            return std::hash<std::uint64_t>()(packed * 0x9E3779B97F4A7C15ULL ^ query.kind);
+        }
+    };
+
+    struct Entry;
+
+    struct LargestHigh
+    { // Largest high end in the subtree, to prune overlap queries.
+        using Data = long long;
+
+        template <typename Node>
+        static void update(Node *node)
+        {
+            node->data = node->value->high;
+            if (node->left && node->left->data > node->data)
+                node->data = node->left->data;
+            if (node->right && node->right->data > node->data)
+                node->data = node->right->data;
+        }
+
+        template <typename Node>
+        static void absorb(Node *ancestor, const Node *added)
+        {
+            if (added->data > ancestor->data)
+                ancestor->data = added->data;
+        }
+    };
+
+    using IntervalTree = RBTree<long long, Entry *, std::less<long long>, SlabPool, LargestHigh>;
+
+    struct Entry
+    {
+        Query query;
+        long long low;
+        long long high;
+        std::string text;
+        IntervalTree::Node *node = nullptr;
+        Entry *older = nullptr; // Recency list, most recent at the head.
+        Entry *newer = nullptr;
+    };
+
+    static constexpr std::size_t kEntryOverhead = sizeof(Entry) + sizeof(IntervalTree::Node) + 32; // Plus the map slot.
+
+    std::unordered_map<Query, Entry *, QueryHash> byQuery;
+    IntervalTree intervals;
+    SlabPool<Entry, 256> entries;
+    Entry *newest = nullptr;
+    Entry *oldest = nullptr;
+    std::size_t bytes = 0;
+    std::size_t budget = kDefaultBudget;
+    std::uint64_t changes = 0;
+    std::vector<std::size_t> recentMisses = std::vector<std::size_t>(kRecentMisses); // Hashes, direct-mapped.
+    Counter hitCount;
+    Counter missCount;
+    Counter evictionCount;
+
+    void unlink(Entry *entry)
+    {
+        (entry->newer ? entry->newer->older : newest) = entry->older;
+        (entry->older ? entry->older->newer : oldest) = entry->newer;
+        entry->older = entry->newer = nullptr;
+    }
+
+    void pushNewest(Entry *entry)
+    {
+        entry->older = newest;
+        (newest ? newest->newer : oldest) = entry;
+        newest = entry;
+    }
+
+    void drop(Entry *entry)
+    {
+        unlink(entry);
+        intervals.erase(entry->node);
+        byQuery.erase(entry->query);
+        bytes -= entry->text.size() + kEntryOverhead;
+        entries.destroy(entry);
+    }
+
+    void overlapping(IntervalTree::Node *node, long long low, long long high, std::vector<Entry *> &found) const
+    { // Collects the entries under node whose interval meets [low, high].
+
+        while (node != nullptr && node->data >= low)
+        {
+            overlapping(node->left, low, high, found);
+            if (node->key > high)
+                return; // Everything to the right starts even later.
+            if (node->value->high >= low)
+                found.push_back(node->value);
+            node = node->right;
+        }
+    }
+
+public:
+    QueryCache() = default;
+    QueryCache(const QueryCache &) = delete;
+    QueryCache &operator=(const QueryCache &) = delete;
+
+    ~QueryCache() { clear(); }
+
+    std::uint64_t epoch() const { return changes; }
+
+    bool admit(Kind kind, int first, int second)
+    { // After a miss: says whether the query missed recently too, and is worth storing this time.
+
+        std::size_t hash = QueryHash()(Query{kind, first, second}) | 1; // Zero marks an empty slot.
+        std::size_t &slot = recentMisses[hash % kRecentMisses];
+        if (slot == hash)
+            return true;
+        slot = hash;
+        return false;
+    }
+
+    bool emit(Kind kind, int first, int second, OutputSink &output)
+    { // Writes the cached result of a query, if there is one.
+
+        auto found = byQuery.find(Query{kind, first, second});
+        if (found == byQuery.end())
+        {
+            missCount.add();
+            return false;
+        }
+        Entry *entry = found->second;
+        if (entry != newest)
+        {
+            unlink(entry);
+            pushNewest(entry);
+        }
+        output << std::string_view(entry->text);
+        hitCount.add();
+        return true;
+    }
+
+    void store(Kind kind, int first, int second, Interval depends, std::string_view text, std::uint64_t seenEpoch)
+    { // Caches a result, unless anything changed since seenEpoch or it would take over an eighth of the budget.
+
+        std::size_t cost = text.size() + kEntryOverhead;
+        if (seenEpoch != changes || cost > largestEntry())
+            return;
+        Query query{kind, first, second};
+        auto found = byQuery.find(query);
+        if (found != byQuery.end())
+            drop(found->second);
+        while (bytes + cost > budget && oldest != nullptr)
+            drop(oldest);
+
+        Entry *entry = entries.create();
+        entry->query = query;
+        entry->low = depends.low;
+        entry->high = depends.high;
+        entry->text.assign(text);
+        entry->node = intervals.insert(depends.low, entry);
+        byQuery.emplace(query, entry);
+        pushNewest(entry);
+        bytes += cost;
+    }
+
+    void invalidate(long long bookID) { invalidate(bookID, bookID); } // Evicts every result that depends on bookID.
+
+    void invalidate(long long low, long long high)
+    { // Evicts every result that depends on a bookID in [low, high].
+
+        ++changes;
+        if (intervals.empty())
+            return;
+        std::vector<Entry *> found;
+        overlapping(intervals.root(), low, high, found);
+        for (Entry *entry : found)
+            drop(entry);
+        evictionCount.add(found.size());
+    }
+
+    void clear()
+    {
+        ++changes;
+        evictionCount.add(byQuery.size());
+        while (oldest != nullptr)
+            drop(oldest);
+    }
+
+    void setBudget(std::size_t maxBytes)
+    { // Text plus bookkeeping the cache may hold; 0 turns caching off.
+
+        budget = maxBytes;
+        while (bytes > budget && oldest != nullptr)
+            drop(oldest);
+    }
+
+    std::size_t largestEntry() const { return budget / 8; } // In bytes, counting bookkeeping.
+    std::size_t size() const { return byQuery.size(); }
+    std::size_t memoryUsed() const { return bytes; }
+    std::uint64_t hits() const { return hitCount.get(); }
+    std::uint64_t misses() const { return missCount.get(); }
+    std::uint64_t evictions() const { return evictionCount.get(); }
+};
+
+#endif
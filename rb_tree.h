@@ -0,0 +1,784 @@
+#ifndef RB_TREE_H
+#define RB_TREE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <type_traits>
+#include <vector>
+#include "slab_pool.h"
+#include "stats.h"
+
+enum Color
+{
+    RED,
+    BLACK
+};
+
+// A red-black tree node. Only what a descent needs sits next to the key: the
+// child links, and the parent pointer with the color packed into its low bit.
+// `data` is the augmentation's per-node value (e.g. the subtree size).
+template <typename Key, typename Value, typename Data>
+struct alignas(64) RBTreeNode
+{
+    Key key;
+    Data data;
+    RBTreeNode *left;
+    RBTreeNode *right;
+    std::uintptr_t parentAndColor;
+    Value value;
+
+    RBTreeNode(const Key &key, const Value &value) : key(key), data(), left(nullptr), right(nullptr), parentAndColor(RED), value(value) {}
+
+    RBTreeNode *parent() const { return reinterpret_cast<RBTreeNode *>(parentAndColor & ~std::uintptr_t(1)); }
+    Color color() const { return static_cast<Color>(parentAndColor & 1); }
+    void setParent(RBTreeNode *p) { parentAndColor = reinterpret_cast<std::uintptr_t>(p) | (parentAndColor & 1); }
+    void setColor(Color c) { parentAndColor = (parentAndColor & ~std::uintptr_t(1)) | c; }
+};
+
+// Augmentations keep a value per node that summarizes its subtree (a count, a
+// maximum), so a rotation just hands the old top's value to the new top. The
+// tree calls update(node) bottom-up wherever a subtree's contents change,
+// and absorb(ancestor, added) on each node an insertion passes on its way
+// down, so an insert needs no second walk back up.
+struct NoAugment
+{
+    struct Data
+    {
+    };
+
+    template <typename Node>
+    static void update(Node *) {}
+
+    template <typename Node>
+    static void absorb(Node *, const Node *) {}
+};
+
+// Subtree node counts, for rank and select in O(log n).
+struct SubtreeSize
+{
+    using Data = int;
+
+    template <typename Node>
+    static int of(const Node *node) { return node == nullptr ? 0 : node->data; }
+
+    template <typename Node>
+    static void update(Node *node) { node->data = 1 + of(node->left) + of(node->right); }
+
+    template <typename Node>
+    static void absorb(Node *ancestor, const Node *) { ++ancestor->data; }
+};
+
+// Red-black tree engine: insertion, deletion and their fixups, lookups and
+// in-order stepping, with the comparator, node allocator and augmentation as
+// template parameters so they inline into every descent. Equal keys are kept
+// in insertion order; find() returns the first one on the search path.
+//
+// Nodes are public: callers may walk them directly (rank, select, custom
+// range scans) and may link a tree themselves, then hand it over with adopt().
+//
+// Recoloring work is tallied in colorFlips(), counted the way GatorLibrary
+// has always reported it for ColorFlipCount: that tally charges 3 for the
+// mirrored recolor-only insert case and 2 for its twin, and it is kept as is
+// because it is part of the command output. Only single-node inserts and
+// erases add to it: bulk builds (buildFromSorted) and the split/join paths
+// (eraseRange, join) recolor without counting, including the fixups those
+// joins run internally. counters() has the exact figures (see stats.h), and
+// shape() measures height and black height.
+template <typename Key, typename Value, typename Compare = std::less<Key>,
+          template <typename> class Allocator = SlabPool, typename Augment = NoAugment>
+class RBTree
+{
+public:
+    using Node = RBTreeNode<Key, Value, typename Augment::Data>;
+
+private:
+    static constexpr bool kAugmented = !std::is_same<Augment, NoAugment>::value;
+
+    Node *rootNode = nullptr;
+    Allocator<Node> pool;
+    Compare less;
+    int flips = 0;
+    mutable TreeCounters stats;
+
+    static bool isBlack(const Node *node) { return node == nullptr || node->color() == BLACK; }
+
+    static void updatePath(Node *node)
+    { // Recomputes the augmentation from node up to the root.
+
+        if constexpr (kAugmented)
+            for (; node != nullptr; node = node->parent())
+                Augment::update(node);
+    }
+
+    void recolor(Node *node, Color color)
+    {
+        if constexpr (kStatsEnabled)
+            if (node->color() != color)
+                stats.recolors.add();
+        node->setColor(color);
+    }
+
+    void replaceChild(Node *parent, Node *old, Node *child)
+    {
+        if (parent == nullptr)
+            rootNode = child;
+        else if (old == parent->left)
+            parent->left = child;
+        else
+            parent->right = child;
+    }
+
+    void leftRotate(Node *x)
+    {
+        Node *y = x->right;
+        x->right = y->left;
+        if (y->left != nullptr)
+            y->left->setParent(x);
+        y->setParent(x->parent());
+        replaceChild(x->parent(), x, y);
+        y->left = x;
+        x->setParent(y);
+        y->data = x->data;
+        Augment::update(x);
+        stats.rotations.add();
+    }
+
+    void rightRotate(Node *y)
+    {
+        Node *x = y->left;
+        y->left = x->right;
+        if (x->right != nullptr)
+            x->right->setParent(y);
+        x->setParent(y->parent());
+        replaceChild(y->parent(), y, x);
+        x->right = y;
+        y->setParent(x);
+        x->data = y->data;
+        Augment::update(y);
+        stats.rotations.add();
+    }
+
+    bool insertFixup(Node *z)
+    { // Returns whether the root had to be blackened, which adds one to the tree's black height.
+
+        while (z != rootNode && z->parent()->color() == RED)
+        {
+            stats.fixupIterations.add();
+            if (z->parent() == z->parent()->parent()->left)
+            {
+                Node *y = z->parent()->parent()->right;
+                if (y && y->color() == RED)
+                {
+                    recolor(z->parent(), BLACK);
+                    recolor(y, BLACK);
+                    recolor(z->parent()->parent(), RED);
+                    z = z->parent()->parent();
+                    flips += 2;
+                }
+                else
+                {
+                    if (z == z->parent()->right)
+                    {
+                        z = z->parent();
+                        leftRotate(z);
+                    }
+                    recolor(z->parent(), BLACK);
+                    recolor(z->parent()->parent(), RED);
+                    rightRotate(z->parent()->parent());
+                    flips += 2;
+                }
+            }
+            else
+            {
+                Node *y = z->parent()->parent()->left;
+                if (y && y->color() == RED)
+                {
+                    recolor(z->parent(), BLACK);
+                    recolor(y, BLACK);
+                    recolor(z->parent()->parent(), RED);
+                    z = z->parent()->parent();
+                    flips += 3;
+                }
+                else
+                {
+                    if (z == z->parent()->left)
+                    {
+                        z = z->parent();
+                        rightRotate(z);
+                    }
+                    recolor(z->parent(), BLACK);
+                    recolor(z->parent()->parent(), RED);
+                    leftRotate(z->parent()->parent());
+                    flips += 2;
+                }
+            }
+        }
+        bool grew = rootNode->color() == RED;
+        recolor(rootNode, BLACK);
+        return grew;
+    }
+
+    void transplant(Node *u, Node *v)
+    {
+        replaceChild(u->parent(), u, v);
+        if (v)
+            v->setParent(u->parent());
+    }
+
+    void eraseFixup(Node *x, Node *xParent)
+    {
+        while (x != rootNode && isBlack(x))
+        {
+            stats.fixupIterations.add();
+            if (x == xParent->left)
+            {
+                Node *w = xParent->right;
+                if (w->color() == RED)
+                { // Case 1: x's sibling w is red
+                    recolor(w, BLACK);
+                    recolor(xParent, RED);
+                    leftRotate(xParent);
+                    w = xParent->right;
+                    flips += 2;
+                }
+                if (isBlack(w->left) && isBlack(w->right))
+                { // Case 2: Both of w's children are black
+                    recolor(w, RED);
+                    x = xParent;
+                    xParent = x->parent();
+                    flips += 1;
+                }
+                else
+                {
+                    if (isBlack(w->right))
+                    { // Case 3: w's right child is black
+                        if (w->left)
+                            recolor(w->left, BLACK);
+                        recolor(w, RED);
+                        rightRotate(w);
+                        w = xParent->right;
+                        flips += 2;
+                    }
+                    recolor(w, xParent->color()); // Case 4: w's right child is red
+                    recolor(xParent, BLACK);
+                    flips += 1;
+                    if (w->right)
+                    {
+                        recolor(w->right, BLACK);
+                        flips += 1;
+                    }
+                    leftRotate(xParent);
+                    x = rootNode;
+                }
+            }
+            else
+            {
+                Node *w = xParent->left;
+                if (w->color() == RED)
+                {
+                    recolor(w, BLACK);
+                    recolor(xParent, RED);
+                    rightRotate(xParent);
+                    w = xParent->left;
+                    flips += 2;
+                }
+                if (isBlack(w->right) && isBlack(w->left))
+                {
+                    recolor(w, RED);
+                    x = xParent;
+                    xParent = x->parent();
+                    flips += 1;
+                }
+                else
+                {
+                    if (isBlack(w->left))
+                    {
+                        if (w->right)
+                        {
+                            recolor(w->right, BLACK);
+                            flips += 1;
+                        }
+                        recolor(w, RED);
+                        flips += 1;
+                        leftRotate(w);
+                        w = xParent->left;
+                    }
+                    recolor(w, xParent->color());
+                    recolor(xParent, BLACK);
+                    flips += 1;
+                    if (w->left)
+                    {
+                        recolor(w->left, BLACK);
+                        flips += 1;
+                    }
+                    rightRotate(xParent);
+                    x = rootNode;
+                }
+            }
+        }
+        if (x)
+        {
+            recolor(x, BLACK);
+            flips += 1;
+        }
+    }
+
+    Node *linkBalanced(std::vector<Node *> &nodes, long lo, long hi, Node *parent, int depth, int redDepth)
+    { // Links nodes[lo..hi] into a balanced subtree. Only the bottom level is red, so every path has the same black height.
+
+        if (lo > hi)
+            return nullptr;
+        long mid = lo + (hi - lo) / 2;
+        Node *node = nodes[mid];
+        node->setParent(parent);
+        node->setColor(depth == redDepth && depth > 0 ? RED : BLACK);
+        node->left = linkBalanced(nodes, lo, mid - 1, node, depth + 1, redDepth);
+        node->right = linkBalanced(nodes, mid + 1, hi, node, depth + 1, redDepth);
+        Augment::update(node);
+        return node;
+    }
+
+    static int blackHeight(const Node *node)
+    { // Black nodes on the way from node down to a leaf, node included.
+
+        int height = 0;
+        for (; node != nullptr; node = node->left)
+            height += node->color() == BLACK;
+        return height;
+    }
+
+    Node *joinAt(Node *left, int leftHeight, Node *middle, Node *right, int rightHeight, int &height)
+    { // Links two detached trees and a node whose key lies between theirs into one tree and returns its
+      // root, with its black height in height. The shorter tree hangs off the taller one's inner spine
+      // at equal black height, under middle, and an insert fixup repairs the colors there. Only the
+      // spine passed on the way down gains nodes, so only it is re-augmented, and the fixup's rotations
+      // keep their own nodes current: O(height difference + 1). Uses rootNode as scratch.
+
+        if (!isBlack(left))
+        {
+            recolor(left, BLACK);
+            ++leftHeight;
+        }
+        if (!isBlack(right))
+        {
+            recolor(right, BLACK);
+            ++rightHeight;
+        }
+        if (leftHeight == rightHeight)
+        {
+            middle->left = left;
+            middle->right = right;
+            middle->setParent(nullptr);
+            middle->setColor(BLACK);
+        }
+        else
+        {
+            bool leftTaller = leftHeight > rightHeight;
+            int target = leftTaller ? rightHeight : leftHeight;
+            height = leftTaller ? leftHeight : rightHeight;
+            Node *parent = nullptr;
+            Node *top = leftTaller ? left : right;
+            Node *spine = top;
+            for (int level = height; level > target || !isBlack(spine); spine = leftTaller ? spine->right : spine->left)
+            {
+                parent = spine;
+                level -= spine->color() == BLACK;
+            }
+            middle->left = leftTaller ? spine : left;
+            middle->right = leftTaller ? right : spine;
+            (leftTaller ? parent->right : parent->left) = middle;
+            middle->setParent(parent);
+            middle->setColor(RED);
+            rootNode = top;
+        }
+        if (middle->left)
+            middle->left->setParent(middle);
+        if (middle->right)
+            middle->right->setParent(middle);
+        Augment::update(middle);
+        if (middle->parent() == nullptr)
+        {
+            height = leftHeight + 1;
+            return rootNode = middle;
+        }
+        if constexpr (kAugmented)
+            for (Node *node = middle->parent();; node = node->parent())
+            { // Back up the spine the descent took, stopping at the taller tree's root.
+
+                Augment::update(node);
+                if (node == rootNode)
+                    break;
+            }
+        if (insertFixup(middle))
+            ++height;
+        return rootNode;
+    }
+
+    Node *concat(Node *left, Node *right)
+    { // Joins two detached trees, every key in left sorting before every key in right, and returns the
+      // root. The first node of right is unlinked to serve as the joining node. O(log n).
+
+        if (left == nullptr || right == nullptr)
+        {
+            Node *only = left ? left : right;
+            if (only)
+                recolor(only, BLACK);
+            return only;
+        }
+        rootNode = right;
+        Node *middle = leftmost(right);
+        unlink(middle);
+        int height;
+        return joinAt(left, blackHeight(left), middle, rootNode, blackHeight(rootNode), height);
+    }
+
+    template <typename GoesLeft>
+    void splitAt(Node *node, int height, GoesLeft goesLeft, Node *&left, int &leftHeight, Node *&right, int &rightHeight)
+    { // Splits the detached subtree at node, of black height height, into the nodes whose keys go left and
+      // the rest, with their black heights. Each level joins what it cut off onto one side; each join
+      // costs its height difference plus one, augmentation included, and those add up to O(log n) over
+      // the whole descent.
+
+        if (node == nullptr)
+        {
+            left = right = nullptr;
+            leftHeight = rightHeight = 0;
+            return;
+        }
+        int childHeight = height - (node->color() == BLACK);
+        Node *lower = node->left;
+        Node *upper = node->right;
+        if (lower)
+            lower->setParent(nullptr);
+        if (upper)
+            upper->setParent(nullptr);
+        if (goesLeft(node->key))
+        {
+            Node *rest;
+            int restHeight;
+            splitAt(upper, childHeight, goesLeft, rest, restHeight, right, rightHeight);
+            left = joinAt(lower, childHeight, node, rest, restHeight, leftHeight);
+        }
+        else
+        {
+            Node *rest;
+            int restHeight;
+            splitAt(lower, childHeight, goesLeft, left, leftHeight, rest, restHeight);
+            right = joinAt(rest, restHeight, node, upper, childHeight, rightHeight);
+        }
+    }
+
+    void unlink(Node *z)
+    { // Takes z out of the tree, rebalancing, without freeing it.
+
+        Node *y = z;
+        Node *x;
+        Node *xParent; // x may be null, so its parent is tracked separately.
+        Color yOriginalColor = y->color();
+
+        if (z->left == nullptr)
+        {
+            x = z->right;
+            xParent = z->parent();
+            transplant(z, z->right);
+        }
+        else if (z->right == nullptr)
+        {
+            x = z->left;
+            xParent = z->parent();
+            transplant(z, z->left);
+        }
+        else
+        {
+            y = leftmost(z->right);
+            yOriginalColor = y->color();
+            x = y->right;
+
+            if (y->parent() == z)
+            {
+                xParent = y;
+                if (x)
+                    x->setParent(y);
+            }
+            else
+            {
+                xParent = y->parent();
+                transplant(y, y->right);
+                y->right = z->right;
+                y->right->setParent(y);
+            }
+
+            transplant(z, y);
+            y->left = z->left;
+            y->left->setParent(y);
+            recolor(y, z->color());
+        }
+        updatePath(xParent); // Everything above the spot that lost a node, before any rotation.
+
+        if (yOriginalColor == BLACK)
+            eraseFixup(x, xParent);
+    }
+
+    template <typename Dispose>
+    void destroySubtree(Node *node, Dispose &dispose)
+    {
+        if (node == nullptr)
+            return;
+        destroySubtree(node->left, dispose);
+        destroySubtree(node->right, dispose);
+        dispose(node->value);
+        pool.destroy(node);
+    }
+
+public:
+    RBTree() = default;
+    RBTree(const RBTree &) = delete;
+    RBTree &operator=(const RBTree &) = delete;
+
+    ~RBTree() { clear(); }
+
+    Node *root() const { return rootNode; }
+    bool empty() const { return rootNode == nullptr; }
+    int colorFlips() const { return flips; }
+    void setColorFlips(int count) { flips = count; }
+    const TreeCounters &counters() const { return stats; }
+
+    TreeShape shape() const
+    { // Node count, height and black height, in one O(n) walk.
+
+        TreeShape shape;
+        struct Visit
+        {
+            const Node *node;
+            int depth;
+            int blackDepth;
+        };
+        std::vector<Visit> stack;
+        if (rootNode)
+            stack.push_back({rootNode, 1, rootNode->color() == BLACK});
+        while (!stack.empty())
+        {
+            Visit visit = stack.back();
+            stack.pop_back();
+            ++shape.nodes;
+            shape.height = std::max(shape.height, visit.depth);
+            for (const Node *child : {visit.node->left, visit.node->right})
+            {
+                if (child)
+                    stack.push_back({child, visit.depth + 1, visit.blackDepth + (child->color() == BLACK)});
+                else
+                    shape.blackHeight = visit.blackDepth; // The same on every path in a valid tree.
+            }
+        }
+        shape.entries = shape.nodes;
+        return shape;
+    }
+
+    static Node *leftmost(Node *node)
+    {
+        while (node->left != nullptr)
+            node = node->left;
+        return node;
+    }
+
+    static Node *rightmost(Node *node)
+    {
+        while (node->right != nullptr)
+            node = node->right;
+        return node;
+    }
+
+    static Node *next(Node *node)
+    { // In-order successor, or null after the last node.
+
+        if (node->right != nullptr)
+            return leftmost(node->right);
+        Node *child = node;
+        node = node->parent();
+        while (node != nullptr && child == node->right)
+        {
+            child = node;
+            node = node->parent();
+        }
+        return node;
+    }
+
+    static Node *prev(Node *node)
+    { // In-order predecessor, or null before the first node.
+
+        if (node->left != nullptr)
+            return rightmost(node->left);
+        Node *child = node;
+        node = node->parent();
+        while (node != nullptr && child == node->left)
+        {
+            child = node;
+            node = node->parent();
+        }
+        return node;
+    }
+
+    Node *first() const { return rootNode ? leftmost(rootNode) : nullptr; }
+    Node *last() const { return rootNode ? rightmost(rootNode) : nullptr; }
+
+    Node *find(const Key &key) const
+    {
+        Node *node = rootNode;
+        std::uint64_t depth = 0;
+        while (node != nullptr)
+        {
+            ++depth;
+            if (less(key, node->key))
+                node = node->left;
+            else if (less(node->key, key))
+                node = node->right;
+            else
+                break;
+        }
+        stats.recordFind(depth);
+        return node;
+    }
+
+    Node *lowerBound(const Key &key) const
+    { // First node whose key is not less than key.
+
+        Node *found = nullptr;
+        for (Node *node = rootNode; node != nullptr;)
+        {
+            if (!less(node->key, key))
+            {
+                found = node;
+                node = node->left;
+            }
+            else
+                node = node->right;
+        }
+        return found;
+    }
+
+    Node *upperBound(const Key &key) const
+    { // First node whose key is greater than key.
+
+        Node *found = nullptr;
+        for (Node *node = rootNode; node != nullptr;)
+        {
+            if (less(key, node->key))
+            {
+                found = node;
+                node = node->left;
+            }
+            else
+                node = node->right;
+        }
+        return found;
+    }
+
+    Node *insert(const Key &key, const Value &value)
+    { // Adds a node after any with an equal key.
+
+        Node *z = pool.create(key, value);
+        Augment::update(z);
+        Node *y = nullptr;
+        Node *x = rootNode;
+        while (x != nullptr)
+        {
+            y = x;
+            Augment::absorb(x, static_cast<const Node *>(z));
+            if (less(key, x->key))
+                x = x->left;
+            else
+                x = x->right;
+        }
+        z->setParent(y);
+        if (y == nullptr)
+            rootNode = z;
+        else if (less(key, y->key))
+            y->left = z;
+        else
+            y->right = z;
+        insertFixup(z);
+        return z;
+    }
+
+    void erase(Node *z)
+    { // Unlinks z and returns it to the allocator. The value is the caller's to dispose of first.
+
+        unlink(z);
+        pool.destroy(z);
+    }
+
+    template <typename Dispose>
+    void eraseRange(const Key &low, const Key &high, Dispose dispose)
+    { // Removes every node with a key in [low, high] and calls dispose(value) on each, in O(log n + k)
+      // for k nodes: the range is split out of the tree, freed, and the two sides are joined back.
+
+        if (rootNode == nullptr || less(high, low))
+            return;
+        int counted = flips; // Split/join recolors are not tallied; see the class comment.
+        Node *whole = rootNode;
+        Node *below, *rest, *inside, *above;
+        int belowHeight, restHeight, insideHeight, aboveHeight;
+        splitAt(whole, blackHeight(whole), [this, &low](const Key &key)
+                { return less(key, low); }, below, belowHeight, rest, restHeight);
+        splitAt(rest, restHeight, [this, &high](const Key &key)
+                { return !less(high, key); }, inside, insideHeight, above, aboveHeight);
+        destroySubtree(inside, dispose);
+        rootNode = concat(below, above);
+        flips = counted;
+    }
+
+    void join(RBTree &other)
+    { // Moves every node of other into this tree in O(log n), leaving other empty. All of other's keys
+      // must sort after all of this tree's, or all before them. This tree's pool takes over other's
+      // chunks, so the moved nodes are freed here from now on.
+
+        pool.adopt(other.pool);
+        Node *theirs = other.rootNode;
+        other.rootNode = nullptr;
+        Node *mine = rootNode;
+        if (theirs == nullptr || mine == nullptr)
+        {
+            rootNode = mine ? mine : theirs;
+            return;
+        }
+        bool after = !less(leftmost(theirs)->key, rightmost(mine)->key);
+        int counted = flips; // Split/join recolors are not tallied; see the class comment.
+        rootNode = after ? concat(mine, theirs) : concat(theirs, mine);
+        flips = counted;
+    }
+
+    Node *createNode(const Key &key, const Value &value) { return pool.create(key, value); }
+
+    void buildFromSorted(std::vector<Node *> &nodes)
+    { // Builds the tree bottom-up in O(n) from nodes made by createNode, already in key order.
+      // The tree must be empty.
+
+        int redDepth = 0; // Depth of the bottom level; every null link sits at redDepth or redDepth + 1.
+        while ((std::size_t(2) << redDepth) <= nodes.size())
+            ++redDepth;
+        rootNode = linkBalanced(nodes, 0, static_cast<long>(nodes.size()) - 1, nullptr, 0, redDepth);
+    }
+
+    void adopt(Node *root)
+    { // Takes over nodes made by createNode and linked by the caller into a valid red-black
+      // tree with its augmentation filled in. The tree must be empty.
+
+        rootNode = root;
+    }
+
+    template <typename Dispose>
+    void clear(Dispose dispose)
+    { // Calls dispose(value) for every node, then frees them all.
+
+        destroySubtree(rootNode, dispose);
+        rootNode = nullptr;
+    }
+
+    void clear()
+    {
+        clear([](Value &) {});
+    }
+};
+
+#endif
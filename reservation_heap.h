@@ -0,0 +1,218 @@
+#ifndef RESERVATION_HEAP_H
+#define RESERVATION_HEAP_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+// `sequence` comes from a library-wide counter and orders reservations of
+// equal priority first come, first served. `timestamp` is wall-clock time and
+// is only filled in when the library is asked to record it.
+struct ReservationNode
+{
+    int patronID;
+    int priority;
+    std::uint64_t sequence;
+    time_t timestamp;
+
+    ReservationNode(int id, int prio, std::uint64_t sequence, time_t timestamp = 0)
+        : patronID(id), priority(prio), sequence(sequence), timestamp(timestamp)
+    {
+    }
+
+    bool operator<(const ReservationNode &other) const
+    { // a < b when b is served first: lower priority value, then the earlier reservation.
+
+        if (priority == other.priority)
+        {
+            return sequence > other.sequence;
+        }
+        return priority > other.priority;
+    }
+};
+
+// Waiting list of one book: a 4-ary heap of reservations with an index from
+// patronID to heap position, so a patron's reservation can be found, cancelled
+// or reprioritized in O(log r). A patron holds at most one reservation here.
+// forEachInOrder() lists the waiters in service order without copying or
+// draining the heap.
+class ReservationHeap
+{
+private:
+    static constexpr std::size_t kArity = 4;
+
+    using Index = std::unordered_map<int, std::size_t>;
+
+    std::vector<ReservationNode> entries;
+    std::unique_ptr<Index> positionOf; // Allocated with the first reservation; most books never get one.
+
+    const std::size_t *find(int patronID) const
+    { // Heap position of the patron's reservation, or null.
+
+        if (!positionOf)
+            return nullptr;
+        auto found = positionOf->find(patronID);
+        return found == positionOf->end() ? nullptr : &found->second;
+    }
+
+    static bool before(const ReservationNode &a, const ReservationNode &b) { return b < a; }
+
+    void place(std::size_t position, const ReservationNode &entry)
+    {
+        entries[position] = entry;
+        (*positionOf)[entry.patronID] = position;
+    }
+
+    void siftUp(std::size_t position)
+    {
+        ReservationNode entry = entries[position];
+        while (position > 0)
+        {
+            std::size_t parent = (position - 1) / kArity;
+            if (!before(entry, entries[parent]))
+                break;
+            place(position, entries[parent]);
+            position = parent;
+        }
+        place(position, entry);
+    }
+
+    void siftDown(std::size_t position)
+    {
+        ReservationNode entry = entries[position];
+        for (;;)
+        {
+            std::size_t first = position * kArity + 1;
+            if (first >= entries.size())
+                break;
+            std::size_t best = first;
+            std::size_t last = std::min(first + kArity, entries.size());
+            for (std::size_t child = first + 1; child < last; ++child)
+                if (before(entries[child], entries[best]))
+                    best = child;
+            if (!before(entries[best], entry))
+                break;
+            place(position, entries[best]);
+            position = best;
+        }
+        place(position, entry);
+    }
+
+    void removeAt(std::size_t position)
+    {
+        positionOf->erase(entries[position].patronID);
+        ReservationNode last = entries.back();
+        entries.pop_back();
+        if (position == entries.size())
+            return;
+        place(position, last);
+        if (position > 0 && before(last, entries[(position - 1) / kArity]))
+            siftUp(position);
+        else
+            siftDown(position);
+    }
+
+public:
+    bool empty() const { return entries.empty(); }
+    std::size_t size() const { return entries.size(); }
+    const ReservationNode &top() const { return entries.front(); }
+    bool contains(int patronID) const { return find(patronID) != nullptr; }
+
+    void push(int patronID, int priority, std::uint64_t sequence, time_t timestamp = 0)
+    { // Adds a reservation. A patron already waiting keeps their place and takes the new priority.
+
+        if (contains(patronID))
+        {
+            update(patronID, priority);
+            return;
+        }
+        if (!positionOf)
+            positionOf = std::make_unique<Index>();
+        entries.emplace_back(patronID, priority, sequence, timestamp);
+        (*positionOf)[patronID] = entries.size() - 1;
+        siftUp(entries.size() - 1);
+    }
+
+    void pop()
+    {
+        if (!entries.empty())
+            removeAt(0);
+    }
+
+    bool cancel(int patronID)
+    { // Drops the patron's reservation. Returns false if they had none.
+
+        const std::size_t *position = find(patronID);
+        if (position == nullptr)
+            return false;
+        removeAt(*position);
+        return true;
+    }
+
+    bool update(int patronID, int priority)
+    { // Changes the priority of the patron's reservation; the reservation time is kept.
+
+        const std::size_t *found = find(patronID);
+        if (found == nullptr)
+            return false;
+        std::size_t position = *found;
+        int old = entries[position].priority;
+        entries[position].priority = priority;
+        if (priority < old)
+            siftUp(position);
+        else if (priority > old)
+            siftDown(position);
+        return true;
+    }
+
+    // The heap array as stored, for snapshots. assignHeapOrder() takes such an
+    // array back and rejects it unless it is a valid heap with one entry per patron.
+    const std::vector<ReservationNode> &heapOrder() const { return entries; }
+
+    bool assignHeapOrder(std::vector<ReservationNode> heap)
+    {
+        for (std::size_t i = 1; i < heap.size(); ++i)
+            if (before(heap[i], heap[(i - 1) / kArity]))
+                return false;
+        auto index = std::make_unique<Index>();
+        for (std::size_t i = 0; i < heap.size(); ++i)
+            if (!index->emplace(heap[i].patronID, i).second)
+                return false;
+        entries = std::move(heap);
+        positionOf = entries.empty() ? nullptr : std::move(index);
+        return true;
+    }
+
+    template <typename Visit>
+    void forEachInOrder(Visit visit) const
+    { // Calls visit(entry) in service order. A best-first walk over the heap: only
+      // the frontier of candidate positions is kept, never a copy of the entries.
+
+        if (entries.empty())
+            return;
+        thread_local std::vector<std::size_t> frontier;
+        frontier.clear();
+        frontier.push_back(0);
+        auto later = [this](std::size_t a, std::size_t b)
+        { return before(entries[b], entries[a]); };
+        while (!frontier.empty())
+        {
+            std::pop_heap(frontier.begin(), frontier.end(), later);
+            std::size_t position = frontier.back();
+            frontier.pop_back();
+            visit(entries[position]);
+            std::size_t first = position * kArity + 1;
+            for (std::size_t child = first; child < first + kArity && child < entries.size(); ++child)
+            {
+                frontier.push_back(child);
+                std::push_heap(frontier.begin(), frontier.end(), later);
+            }
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,553 @@
+#ifndef SHARD_REPLAY_H
+#define SHARD_REPLAY_H
+
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include "command_parser.h"
+#include "gator_library.h"
+#include "output_sink.h"
+
+// Replays command logs on several independent GatorLibrary shards. Each
+// shard owns a contiguous bookID range, and the ranges are split at quantiles
+// of the InsertBook IDs in the input. Several files are replayed as one log in
+// the order given, and a Quit only ends its own file.
+//
+// Commands are read in batches. Every shard applies its share of a batch on a
+// worker thread and captures the output per command. The pieces are then
+// stitched together in command order, so the result matches a single library.
+// Commands that need every shard are split up and their results combined:
+//   PrintBooks       each overlapping shard prints its part, in range order
+//   DeleteRange      each overlapping shard deletes its part, in range order
+//   CountBooks       per-shard counts are summed
+//   RankOf           lower shards report their size, the owner its local rank
+//   FindClosestBook  each shard offers its nearest books, the closest win
+//   ColorFlipCount   per-shard counts are summed
+//   ReturnAll        each shard returns the patron's books it owns, in range order
+//   FindByAuthor     each shard prints its matches, in range order
+// FindByTitlePrefix merges per-shard matches by title. It, SelectBook and
+// PrintPatron need every shard's state at that exact point, so
+// they end the batch and run on their own, as do the whole-library commands:
+//   SaveSnapshot     the shards are gathered into one library, which is saved
+//   LoadSnapshot     the image is loaded into one library, then dealt out by range
+//   Stats            each shard prints its own, under a "Shard s:" line
+// A snapshot written here loads in a serial run and the other way round. The
+// color flip tally is per shard, so a loaded snapshot's tally is not kept.
+class ShardedReplay
+{
+private:
+    struct Piece
+    { // Output (and a value, for aggregated commands) one shard produced for one command.
+        std::size_t command;
+        std::size_t begin;
+        std::size_t end;
+        long long value;
+    };
+
+    struct Offer
+    { // A piece's text, resolved against the shard that produced it.
+        std::string_view text;
+        long long value;
+    };
+
+    struct Shard
+    {
+        GatorLibrary library;
+        OutputSink capture;
+        std::vector<Piece> pieces;
+        std::vector<std::size_t> tasks; // Indexes into the batch, in order.
+    };
+
+    struct Route
+    { // Shards a command touches: first..last inclusive.
+        int first;
+        int last;
+    };
+
+    static constexpr std::size_t kBatchCommands = 1 << 16;
+
+    std::vector<std::unique_ptr<Shard>> shards;
+    std::vector<int> splits; // Shard s owns [splits[s - 1], splits[s]).
+    std::vector<Command> batch;
+    std::vector<Route> routes;
+    int workers;
+
+    int shardOf(int bookID) const
+    {
+        return static_cast<int>(std::upper_bound(splits.begin(), splits.end(), bookID) - splits.begin());
+    }
+
+    int lastShard() const { return static_cast<int>(shards.size()) - 1; }
+
+    void partition(const std::vector<std::string> &filenames)
+    { // Picks split points at quantiles of the InsertBook IDs.
+
+        std::vector<int> ids;
+        for (const std::string &filename : filenames)
+        {
+            CommandParser parser(filename); // A private mapping of its own, so the replay pass sees the file untouched.
+            Command command;
+            while (parser.next(command) && command.type != CommandType::Quit)
+                if (command.type == CommandType::InsertBook)
+                    ids.push_back(command.integer(0));
+        }
+        splits.assign(shards.size() - 1, 0); // With no IDs at all every split is 0.
+        for (std::size_t s = 1; s < shards.size() && !ids.empty(); ++s)
+        {
+            auto quantile = ids.begin() + ids.size() * s / shards.size();
+            std::nth_element(ids.begin(), quantile, ids.end());
+            splits[s - 1] = *quantile; // Later quantiles are never smaller, so splits stay sorted.
+        }
+    }
+
+    Route routeOf(const Command &command) const
+    {
+        switch (command.type)
+        {
+        case CommandType::InsertBook:
+        case CommandType::PrintBook:
+        case CommandType::DeleteBook:
+            return {shardOf(command.integer(0)), shardOf(command.integer(0))};
+        case CommandType::BorrowBook:
+        case CommandType::ReturnBook:
+        case CommandType::CancelReservation:
+        case CommandType::UpdatePriority:
+            return {shardOf(command.integer(1)), shardOf(command.integer(1))};
+        case CommandType::PrintBooks:
+        case CommandType::DeleteRange:
+        case CommandType::CountBooks:
+        {
+            int bookID1 = command.integer(0), bookID2 = command.integer(1);
+            if (bookID1 > bookID2) // An empty range: only CountBooks has anything to say (0).
+                return command.type == CommandType::CountBooks ? Route{0, 0} : Route{0, -1};
+            return {shardOf(bookID1), shardOf(bookID2)};
+        }
+        case CommandType::RankOf:
+            return {0, shardOf(command.integer(0))};
+        case CommandType::FindClosestBook:
+        case CommandType::ColorFlipCount:
+        case CommandType::ReturnAll:
+        case CommandType::FindByAuthor:
+            return {0, lastShard()};
+        default:
+            return {0, -1};
+        }
+    }
+
+    void offerClosest(Shard &shard, int s, std::size_t index, int targetID)
+    { // Records this shard's candidates for FindClosestBook: the owner's neighbours of
+      // targetID, or the edge book facing it from a shard below or above.
+
+        GatorLibrary &library = shard.library;
+        int owner = shardOf(targetID);
+        BookCursor candidates[2];
+        if (s < owner)
+            candidates[0] = library.Last();
+        else if (s > owner)
+            candidates[0] = library.First();
+        else
+        {
+            BookCursor after = library.LowerBound(targetID);
+            if (after.valid() && after.bookID() == targetID)
+                candidates[0] = after;
+            else
+            {
+                candidates[0] = after.valid() ? BookCursor(after).prev() : library.Last();
+                candidates[1] = after;
+            }
+        }
+        for (BookCursor candidate : candidates)
+        {
+            if (!candidate.valid())
+                continue;
+            std::size_t begin = shard.capture.size();
+            library.PrintBook(candidate, shard.capture);
+            shard.pieces.push_back({index, begin, shard.capture.size(), candidate.bookID()});
+        }
+    }
+
+    void execute(int s, std::size_t index)
+    {
+        Shard &shard = *shards[s];
+        GatorLibrary &library = shard.library;
+        OutputSink &output = shard.capture;
+        const Command &command = batch[index];
+        std::size_t begin = output.size();
+        long long value = 0;
+
+        switch (command.type)
+        {
+        case CommandType::InsertBook:
+            library.InsertBook(command.integer(0), command.fields[1], command.fields[2], command.fields[3] == "Yes", -1);
+            return;
+        case CommandType::PrintBook:
+            library.PrintBook(command.integer(0), output);
+            break;
+        case CommandType::PrintBooks:
+            library.PrintBooks(command.integer(0), command.integer(1), output);
+            break;
+        case CommandType::BorrowBook:
+            library.BorrowBook(command.integer(0), command.integer(1), command.integer(2), output);
+            break;
+        case CommandType::ReturnBook:
+            library.ReturnBook(command.integer(0), command.integer(1), output);
+            break;
+        case CommandType::DeleteBook:
+            library.DeleteBook(command.integer(0), output);
+            break;
+        case CommandType::DeleteRange:
+            library.DeleteRange(command.integer(0), command.integer(1), output);
+            break;
+        case CommandType::CancelReservation:
+            library.CancelReservation(command.integer(0), command.integer(1), output);
+            break;
+        case CommandType::UpdatePriority:
+            library.UpdatePriority(command.integer(0), command.integer(1), command.integer(2), output);
+            break;
+        case CommandType::CountBooks:
+            value = library.BookCount(command.integer(0), command.integer(1));
+            break;
+        case CommandType::RankOf:
+            value = s == shardOf(command.integer(0)) ? library.Rank(command.integer(0)) : library.Size();
+            break;
+        case CommandType::ColorFlipCount:
+            value = library.ColorFlips();
+            break;
+        case CommandType::ReturnAll:
+            value = library.ReturnHeldBooks(command.integer(0), output);
+            break;
+        case CommandType::FindByAuthor:
+            value = library.PrintBooksByAuthor(command.fields[0], output);
+            break;
+        case CommandType::FindClosestBook:
+            offerClosest(shard, s, index, command.integer(0));
+            return;
+        default:
+            return;
+        }
+        shard.pieces.push_back({index, begin, output.size(), value});
+    }
+
+    static void mergeClosest(int targetID, const std::vector<Offer> &offers, OutputSink &output)
+    {
+        if (offers.empty())
+        {
+            output << "Library is empty." << '\n';
+            return;
+        }
+        long long best = -1;
+        for (const Offer &offer : offers)
+        {
+            long long distance = std::llabs(offer.value - targetID);
+            if (best < 0 || distance < best)
+                best = distance;
+        }
+        for (const Offer &offer : offers) // Already in bookID order: shards ascend and each offers in order.
+            if (std::llabs(offer.value - targetID) == best)
+                output << offer.text;
+    }
+
+    void runBatch(OutputSink &output)
+    { // Applies the batch on the shards in parallel, then stitches the output together.
+
+        if (batch.empty())
+            return;
+        std::atomic<int> nextShard(0);
+        auto work = [&]
+        {
+            for (int s; (s = nextShard.fetch_add(1)) < static_cast<int>(shards.size());)
+                for (std::size_t index : shards[s]->tasks)
+                    execute(s, index);
+        };
+        std::vector<std::thread> threads;
+        for (int t = 1; t < workers; ++t)
+            threads.emplace_back(work);
+        work();
+        for (std::thread &thread : threads)
+            thread.join();
+
+        std::vector<std::size_t> cursor(shards.size(), 0);
+        std::vector<Offer> pieces;
+        for (std::size_t index = 0; index < batch.size(); ++index)
+        {
+            pieces.clear();
+            for (int s = routes[index].first; s <= routes[index].last; ++s)
+            {
+                Shard &shard = *shards[s];
+                for (; cursor[s] < shard.pieces.size() && shard.pieces[cursor[s]].command == index; ++cursor[s])
+                {
+                    const Piece &piece = shard.pieces[cursor[s]];
+                    pieces.push_back({shard.capture.contents().substr(piece.begin, piece.end - piece.begin), piece.value});
+                }
+            }
+
+            const Command &command = batch[index];
+            long long total = 0;
+            switch (command.type)
+            {
+            case CommandType::ColorFlipCount:
+                for (const Offer &piece : pieces)
+                    total += piece.value;
+                output << "Color Flip Count: " << total << '\n';
+                break;
+            case CommandType::CountBooks:
+                for (const Offer &piece : pieces)
+                    total += piece.value;
+                GatorLibrary::PrintBookCount(static_cast<int>(total), output);
+                break;
+            case CommandType::RankOf:
+            {
+                long long local = pieces.empty() ? 0 : pieces.back().value; // The owner is the last shard routed.
+                for (std::size_t i = 0; i + 1 < pieces.size(); ++i)
+                    total += pieces[i].value;
+                GatorLibrary::PrintRank(command.integer(0), local == 0 ? 0 : static_cast<int>(total + local), output);
+                break;
+            }
+            case CommandType::FindClosestBook:
+                mergeClosest(command.integer(0), pieces, output);
+                break;
+            case CommandType::ReturnAll:
+                for (const Offer &piece : pieces)
+                {
+                    output << piece.text;
+                    total += piece.value;
+                }
+                if (total == 0)
+                    GatorLibrary::PrintNothingToReturn(command.integer(0), output);
+                break;
+            case CommandType::FindByAuthor:
+                for (const Offer &piece : pieces)
+                {
+                    output << piece.text;
+                    total += piece.value;
+                }
+                if (total == 0)
+                    GatorLibrary::PrintNoMatches("by", command.fields[0], output);
+                break;
+            default:
+                for (const Offer &piece : pieces)
+                    output << piece.text;
+            }
+        }
+
+        for (std::unique_ptr<Shard> &shard : shards)
+        {
+            shard->capture.clear();
+            shard->pieces.clear();
+            shard->tasks.clear();
+        }
+        batch.clear();
+        routes.clear();
+    }
+
+    void selectBook(int rank, OutputSink &output)
+    { // SelectBook across shards: find the shard holding the rank-th book, then select locally.
+
+        int remaining = rank;
+        for (std::unique_ptr<Shard> &shard : shards)
+        {
+            int size = shard->library.Size();
+            if (remaining >= 1 && remaining <= size)
+            {
+                shard->library.SelectBook(remaining, output);
+                return;
+            }
+            remaining -= size;
+        }
+        shards.front()->library.SelectBook(rank, output); // Out of range for every shard, so this prints the usual "no book" line.
+    }
+
+    void printPatron(int patronID, OutputSink &output)
+    { // PrintPatron across shards: shards own ascending ranges, so the lists concatenate in order.
+
+        std::vector<int> held, reserved;
+        for (std::unique_ptr<Shard> &shard : shards)
+        {
+            std::vector<int> shardHeld = shard->library.HeldBy(patronID), shardReserved = shard->library.ReservedBy(patronID);
+            held.insert(held.end(), shardHeld.begin(), shardHeld.end());
+            reserved.insert(reserved.end(), shardReserved.begin(), shardReserved.end());
+        }
+        GatorLibrary::PrintPatronBooks(patronID, held, reserved, output);
+    }
+
+    void findByTitlePrefix(std::string_view prefix, OutputSink &output)
+    { // FindByTitlePrefix across shards: the per-shard matches combined in (title, bookID) order.
+
+        struct Match
+        {
+            const Book *book;
+            GatorLibrary *library;
+        };
+        std::vector<Match> matches;
+        for (std::unique_ptr<Shard> &shard : shards)
+            for (const Book *book : shard->library.BooksWithTitlePrefix(prefix))
+                matches.push_back({book, &shard->library});
+        std::stable_sort(matches.begin(), matches.end(), [](const Match &a, const Match &b)
+                         { return a.book->bookName != b.book->bookName ? a.book->bookName < b.book->bookName : a.book->bookID < b.book->bookID; });
+        for (const Match &match : matches)
+            match.library->PrintBook(*match.book, output);
+        if (matches.empty())
+            GatorLibrary::PrintNoMatches("with a title starting with", prefix, output);
+    }
+
+    static void copyBooks(const GatorLibrary &from, int low, int high, GatorLibrary &into)
+    { // Copies the books in [low, high] with their loans and queues into an empty library. The
+      // loans and reservations are replayed as BorrowBooks in service order, so the queues keep it.
+
+        std::vector<BookRecord> records;
+        std::vector<const Book *> books;
+        for (BookCursor cursor = from.LowerBound(low); cursor.valid() && cursor.bookID() <= high; cursor.next())
+        {
+            const Book &book = cursor.book();
+            records.push_back({book.bookID, book.bookName, book.authorName, true});
+            books.push_back(&book);
+        }
+        into.BulkLoad(records.begin(), records.end());
+        OutputSink discard(-1);
+        for (const Book *book : books)
+        {
+            if (book->borrowedBy != -1)
+                into.BorrowBook(book->borrowedBy, book->bookID, 0, discard);
+            book->reservationHeap.forEachInOrder([&](const ReservationNode &waiting)
+                                                 { into.BorrowBook(waiting.patronID, book->bookID, waiting.priority, discard); });
+        }
+    }
+
+    int lowestOf(int s) const { return s == 0 ? INT_MIN : splits[s - 1]; }
+
+    int highestOf(int s) const { return s == lastShard() ? INT_MAX : splits[s] - 1; }
+
+    void saveSnapshot(const std::string &path, std::uint64_t position, OutputSink &output)
+    { // SaveSnapshot across shards: the shards' books, gathered in range order, saved as one library.
+
+        GatorLibrary whole;
+        for (int s = 0; s <= lastShard(); ++s)
+            copyBooks(shards[s]->library, lowestOf(s), highestOf(s), whole);
+        output << (whole.SaveSnapshot(path, position) ? "Snapshot saved to " : "Snapshot could not be saved to ") << path << '\n';
+    }
+
+    void loadSnapshot(const std::string &path, OutputSink &output)
+    { // LoadSnapshot across shards: each shard is emptied and refilled with its range of the image.
+      // An unusable image leaves the shards as they were.
+
+        GatorLibrary whole;
+        if (!whole.LoadSnapshot(path))
+        {
+            output << "Snapshot could not be loaded from " << path << '\n';
+            return;
+        }
+        OutputSink discard(-1);
+        for (int s = 0; s <= lastShard(); ++s)
+        {
+            GatorLibrary &library = shards[s]->library;
+            library.DeleteRange(INT_MIN, INT_MAX, discard);
+            copyBooks(whole, lowestOf(s), highestOf(s), library);
+        }
+        output << "Snapshot loaded from " << path << '\n';
+    }
+
+    void stats(OutputSink &output)
+    {
+        for (int s = 0; s <= lastShard(); ++s)
+        {
+            output << "Shard " << s << ":\n";
+            shards[s]->library.Stats(output);
+        }
+    }
+
+public:
+    ShardedReplay(int shardCount, int workerCount)
+        : workers(std::max(1, workerCount))
+    {
+        for (int s = 0; s < std::max(1, shardCount); ++s)
+            shards.push_back(std::make_unique<Shard>());
+    }
+
+    bool run(const std::vector<std::string> &filenames, OutputSink &output, OutputSink &console)
+    { // Replays the files in order. Returns false if one cannot be opened.
+
+        for (const std::string &filename : filenames)
+            if (!CommandParser(filename).isOpen())
+                return false;
+        partition(filenames);
+
+        std::vector<std::unique_ptr<CommandParser>> parsers; // Batches hold views into these.
+        for (const std::string &filename : filenames)
+        {
+            parsers.push_back(std::make_unique<CommandParser>(filename));
+            CommandParser &parser = *parsers.back();
+            for (std::unique_ptr<Shard> &shard : shards)
+                shard->library.AdoptText(parser.text(), parser.keepAlive());
+            Command command;
+            std::uint64_t position = 0; // As t1 counts it: commands read from this file so far.
+            while (parser.next(command) && command.type != CommandType::Quit)
+            {
+                ++position;
+                if (command.type == CommandType::InsertBook)
+                {
+                    for (std::string_view field : command.fields)
+                        console << field << '\n';
+                    printInsertResult(console, command.fields[3] == "Yes");
+                }
+                if (command.type == CommandType::SelectBook)
+                {
+                    runBatch(output);
+                    selectBook(command.integer(0), output);
+                    continue;
+                }
+                if (command.type == CommandType::PrintPatron)
+                {
+                    runBatch(output);
+                    printPatron(command.integer(0), output);
+                    continue;
+                }
+                if (command.type == CommandType::FindByTitlePrefix)
+                {
+                    runBatch(output);
+                    findByTitlePrefix(command.fields[0], output);
+                    continue;
+                }
+                if (command.type == CommandType::SaveSnapshot)
+                {
+                    runBatch(output);
+                    saveSnapshot(std::string(command.fields[0]), position, output);
+                    continue;
+                }
+                if (command.type == CommandType::LoadSnapshot)
+                {
+                    runBatch(output);
+                    loadSnapshot(std::string(command.fields[0]), output);
+                    continue;
+                }
+                if (command.type == CommandType::Stats)
+                {
+                    runBatch(output);
+                    stats(output);
+                    continue;
+                }
+
+                Route route = routeOf(command);
+                if (route.first > route.last)
+                    continue;
+                batch.push_back(command);
+                routes.push_back(route);
+                for (int s = route.first; s <= route.last; ++s)
+                    shards[s]->tasks.push_back(batch.size() - 1);
+                if (batch.size() == kBatchCommands)
+                    runBatch(output);
+            }
+            runBatch(output);
+        }
+        return true;
+    }
+};
+
+#endif
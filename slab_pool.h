@@ -0,0 +1,106 @@
+#ifndef SLAB_POOL_H
+#define SLAB_POOL_H
+
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+// Fixed-size slab allocator. Objects are carved out of large chunks, freed
+// slots are recycled through an intrusive free list, and every chunk is
+// released in bulk when the pool goes away.
+template <typename T, std::size_t SlotsPerChunk = 4096>
+class SlabPool
+{
+private:
+    union Slot
+    {
+        Slot *next;
+        alignas(T) unsigned char storage[sizeof(T)];
+    };
+
+    std::vector<std::unique_ptr<Slot[]>> chunks;
+    Slot *freeList = nullptr;
+    std::size_t nextUnused = SlotsPerChunk; // Next never-used slot in the newest chunk.
+    std::size_t liveCount = 0;
+
+    Slot *acquire()
+    { // Pops a recycled slot, or takes the next fresh one (allocating a chunk when needed).
+
+        if (freeList != nullptr)
+        {
+            Slot *slot = freeList;
+            freeList = slot->next;
+            return slot;
+        }
+        if (nextUnused == SlotsPerChunk)
+        {
+            chunks.emplace_back(new Slot[SlotsPerChunk]);
+            nextUnused = 0;
+        }
+        return &chunks.back()[nextUnused++];
+    }
+
+    void release(Slot *slot)
+    {
+        slot->next = freeList;
+        freeList = slot;
+    }
+
+public:
+    SlabPool() = default;
+    SlabPool(const SlabPool &) = delete;
+    SlabPool &operator=(const SlabPool &) = delete;
+
+    // Live objects are not destroyed here; the owner must destroy() them first.
+    ~SlabPool() = default;
+
+    template <typename... Args>
+    T *create(Args &&...args)
+    { // Constructs a T in a pooled slot.
+
+        Slot *slot = acquire();
+        try
+        {
+            T *object = new (slot->storage) T(std::forward<Args>(args)...);
+            ++liveCount;
+            return object;
+        }
+        catch (...)
+        {
+            release(slot);
+            throw;
+        }
+    }
+
+    void destroy(T *object)
+    { // Runs the destructor and returns the slot to the free list.
+
+        object->~T();
+        release(reinterpret_cast<Slot *>(object));
+        --liveCount;
+    }
+
+    void adopt(SlabPool &other)
+    { // Takes over other's chunks, whose memory is now released with this pool's. Other's live objects
+      // count as this pool's, but destroying them is still up to the caller, through this pool's destroy().
+      // Other's free and never-used slots are not reused; they go when this pool does.
+
+        if (other.chunks.empty())
+            return;
+        auto at = chunks.empty() ? chunks.end() : chunks.end() - 1; // The newest chunk stays last.
+        chunks.insert(at, std::make_move_iterator(other.chunks.begin()), std::make_move_iterator(other.chunks.end()));
+        liveCount += other.liveCount;
+        other.chunks.clear();
+        other.freeList = nullptr;
+        other.nextUnused = SlotsPerChunk;
+        other.liveCount = 0;
+    }
+
+    std::size_t size() const { return liveCount; }
+    std::size_t capacity() const { return chunks.size() * SlotsPerChunk; }
+};
+
+#endif
@@ -0,0 +1,116 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// On-disk image of a GatorLibrary, written by SaveSnapshot and read back by
+// LoadSnapshot. All records are fixed size and naturally aligned, so a loaded
+// file is used straight out of its mapping:
+//
+//   SnapshotHeader
+//   SnapshotBook        x books          in bookID order
+//   SnapshotReservation x reservations   each book's heap array, in book order
+//   name text           stringBytes      titles, then each author once
+//
+// Every book records the in-order index of its parent and its color, so the
+// loader rebuilds the exact tree that was saved in one linear pass.
+
+struct SnapshotHeader
+{
+    static constexpr char kMagic[8] = {'G', 'L', 'S', 'N', 'A', 'P', '\0', '\0'};
+    static constexpr std::uint32_t kVersion = 2;
+
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t headerSize;
+    std::uint64_t books;
+    std::uint64_t reservations;
+    std::uint64_t stringBytes;
+    std::uint64_t reservationSequence;
+    std::int64_t colorFlipCount;
+    std::uint64_t logPosition; // Commands of the input log already reflected in the image.
+    std::uint64_t walSequence; // Last write-ahead log record reflected in the image (0: none).
+};
+
+// Which image a LoadSnapshot read, as the write-ahead log records it. A path
+// can be saved over later, so replay checks that the file there is still
+// this image before loading it.
+struct SnapshotIdentity
+{
+    std::uint64_t walSequence = 0; // From the image's header.
+    std::uint64_t size = 0;        // Of the whole file.
+    std::uint32_t checksum = 0;    // CRC-32 of the whole file.
+};
+
+struct SnapshotBook
+{
+    std::int32_t bookID;
+    std::int32_t parent; // In-order index of the parent node; -1 for the root.
+    std::int32_t borrowedBy;
+    std::uint32_t reservationCount;
+    std::uint64_t titleOffset;
+    std::uint64_t authorOffset;
+    std::uint32_t titleLength;
+    std::uint32_t authorLength;
+    std::uint8_t available;
+    std::uint8_t color;
+    std::uint8_t padding[6];
+};
+
+struct SnapshotReservation
+{
+    std::int32_t patronID;
+    std::int32_t priority;
+    std::uint64_t sequence;
+    std::int64_t timestamp;
+};
+
+// Read-only mapping of a whole file. Held through a shared_ptr by a library
+// whose book titles point into it.
+class MappedFile
+{
+private:
+    const char *bytes = nullptr;
+    std::size_t length = 0;
+
+public:
+    explicit MappedFile(const std::string &path)
+    {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return;
+        struct stat info;
+        if (::fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0)
+        {
+            void *map = ::mmap(nullptr, static_cast<std::size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if (map != MAP_FAILED)
+            {
+                bytes = static_cast<const char *>(map);
+                length = static_cast<std::size_t>(info.st_size);
+            }
+        }
+        ::close(fd);
+    }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    ~MappedFile()
+    {
+        if (bytes)
+            ::munmap(const_cast<char *>(bytes), length);
+    }
+
+    bool isOpen() const { return bytes != nullptr; }
+    const char *data() const { return bytes; }
+    std::size_t size() const { return length; }
+};
+
+#endif
@@ -0,0 +1,111 @@
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <thread>
+
+// Bounded lock-free queue for exactly one producer thread and one consumer
+// thread. The producer only writes `tail` and the consumer only writes
+// `head`, each on its own cache line, and each side keeps a cached copy of
+// the other's index so it touches the shared line only when the cached copy
+// says the ring is full (or empty). Capacity is rounded up to a power of two.
+template <typename T>
+class SpscRing
+{
+private:
+    static constexpr std::size_t kLine = 64;
+
+    std::unique_ptr<T[]> slots;
+    std::size_t mask;
+
+    alignas(kLine) std::atomic<std::size_t> head{0}; // Next slot to pop; written by the consumer.
+    std::size_t tailSeen = 0;                        // The consumer's copy of tail.
+
+    alignas(kLine) std::atomic<std::size_t> tail{0}; // Next slot to push; written by the producer.
+    std::size_t headSeen = 0;                        // The producer's copy of head.
+
+    static std::size_t roundUp(std::size_t capacity)
+    {
+        std::size_t size = 1;
+        while (size < capacity)
+            size *= 2;
+        return size;
+    }
+
+public:
+    explicit SpscRing(std::size_t capacity)
+        : slots(new T[roundUp(capacity)]), mask(roundUp(capacity) - 1)
+    {
+    }
+
+    SpscRing(const SpscRing &) = delete;
+    SpscRing &operator=(const SpscRing &) = delete;
+
+    bool tryPush(T &item)
+    { // Producer only. Moves item in, or returns false (leaving it alone) when the ring is full.
+
+        std::size_t at = tail.load(std::memory_order_relaxed);
+        if (at - headSeen > mask)
+        {
+            headSeen = head.load(std::memory_order_acquire);
+            if (at - headSeen > mask)
+                return false;
+        }
+        slots[at & mask] = std::move(item);
+        tail.store(at + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool tryPop(T &item)
+    { // Consumer only. Returns false when the ring is empty.
+
+        std::size_t at = head.load(std::memory_order_relaxed);
+        if (at == tailSeen)
+        {
+            tailSeen = tail.load(std::memory_order_acquire);
+            if (at == tailSeen)
+                return false;
+        }
+        item = std::move(slots[at & mask]);
+        head.store(at + 1, std::memory_order_release);
+        return true;
+    }
+};
+
+// How a thread waits on a ring with nothing for it: a few rounds of giving up
+// its time slice, then sleeps that double up to a millisecond. An idle stage
+// costs next to nothing, and the rings hold enough work ahead that the
+// sleeper is back before its neighbour runs dry.
+class Backoff
+{
+private:
+    static constexpr int kYields = 64;
+    static constexpr int kLongestSleepUs = 1000;
+    int rounds = 0;
+    int sleepUs = 10;
+
+public:
+    void pause()
+    {
+        if (rounds < kYields)
+        {
+            ++rounds;
+            std::this_thread::yield();
+            return;
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(sleepUs));
+        sleepUs = std::min(2 * sleepUs, kLongestSleepUs);
+    }
+
+    void reset()
+    {
+        rounds = 0;
+        sleepUs = 10;
+    }
+};
+
+#endif
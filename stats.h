@@ -0,0 +1,191 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+// Instrumentation of the hot paths: tree work counters and per-command
+// latency histograms. Build with -DGATOR_STATS=0 to compile all of it out;
+// the counters then become empty no-ops and no clock is read.
+#ifndef GATOR_STATS
+#define GATOR_STATS 1
+#endif
+
+constexpr bool kStatsEnabled = GATOR_STATS != 0;
+
+// Event counter bumped from paths that run under a shared lock. The update is
+// a plain relaxed load and store rather than a locked add, so it costs no more
+// than an ordinary increment; two threads racing can lose a count, which makes
+// the figures approximate under concurrent readers and exact otherwise.
+class StatCounter
+{
+private:
+    std::atomic<std::uint64_t> count{0};
+
+public:
+    void add(std::uint64_t n = 1) { count.store(count.load(std::memory_order_relaxed) + n, std::memory_order_relaxed); }
+
+    void raiseTo(std::uint64_t n)
+    { // Keeps the largest value seen.
+
+        if (n > count.load(std::memory_order_relaxed))
+            count.store(n, std::memory_order_relaxed);
+    }
+
+    std::uint64_t get() const { return count.load(std::memory_order_relaxed); }
+    void reset() { count.store(0, std::memory_order_relaxed); }
+};
+
+struct NullCounter
+{
+    void add(std::uint64_t = 1) {}
+    void raiseTo(std::uint64_t) {}
+    std::uint64_t get() const { return 0; }
+    void reset() {}
+};
+
+using Counter = std::conditional_t<kStatsEnabled, StatCounter, NullCounter>;
+
+// Work done by a search tree's updates and lookups.
+struct TreeCounters
+{
+    Counter rotations;
+    Counter recolors;        // Nodes whose color actually changed.
+    Counter fixupIterations; // Passes through the insert and erase fixup loops.
+    Counter splits;          // Node splits (B+-tree).
+    Counter merges;          // Underfull nodes merged into a sibling (B+-tree).
+    Counter finds;
+    Counter findDepth; // Nodes visited by all finds together.
+    Counter maxFindDepth;
+
+    void recordFind(std::uint64_t depth)
+    {
+        finds.add();
+        findDepth.add(depth);
+        maxFindDepth.raiseTo(depth);
+    }
+};
+
+// Shape of an index, measured on demand by walking it.
+struct TreeShape
+{
+    std::uint64_t entries = 0;
+    std::uint64_t nodes = 0;
+    int height = 0;      // Nodes on the longest root-to-leaf path.
+    int blackHeight = 0; // Black nodes on every root-to-null path (0 where there are no colors).
+};
+
+// Log-linear latency histogram in the style of HdrHistogram: each power-of-two
+// range of nanoseconds is split into 32 equal sub-buckets, so any recorded
+// value is known to within about 3% across the whole range from 1 ns up.
+//
+// Reading the clock costs about as much as a cached lookup, so only every
+// kSampleInterval-th call is timed (the first one always is). Calls are
+// counted exactly; the mean, percentiles and maximum come from the sample.
+class LatencyHistogram
+{
+public:
+    static constexpr int kSubBucketBits = 5;
+    static constexpr int kSubBuckets = 1 << kSubBucketBits;
+    static constexpr int kBuckets = (64 - kSubBucketBits + 1) * kSubBuckets;
+    static constexpr std::uint64_t kSampleInterval = 16;
+
+private:
+    Counter buckets[kBuckets];
+    Counter calls;
+    Counter sampled;
+    Counter sum;
+    Counter largest;
+
+    static int bucketOf(std::uint64_t ns)
+    {
+        if (ns < static_cast<std::uint64_t>(kSubBuckets))
+            return static_cast<int>(ns);
+        int magnitude = 63 - __builtin_clzll(ns); // At least kSubBucketBits here.
+        int shift = magnitude - kSubBucketBits;
+        return (shift + 1) * kSubBuckets + static_cast<int>((ns >> shift) & (kSubBuckets - 1));
+    }
+
+    static std::uint64_t highestIn(int bucket)
+    { // Largest value that lands in bucket.
+
+        if (bucket < kSubBuckets)
+            return static_cast<std::uint64_t>(bucket);
+        int shift = bucket / kSubBuckets - 1;
+        std::uint64_t low = (static_cast<std::uint64_t>(kSubBuckets) + bucket % kSubBuckets) << shift;
+        return low + ((std::uint64_t(1) << shift) - 1);
+    }
+
+public:
+    bool sampleNext()
+    { // Counts a call and says whether to time it.
+
+        calls.add();
+        return calls.get() % kSampleInterval == 1;
+    }
+
+    void record(std::uint64_t ns)
+    {
+        buckets[bucketOf(ns)].add();
+        sampled.add();
+        sum.add(ns);
+        largest.raiseTo(ns);
+    }
+
+    std::uint64_t count() const { return calls.get(); }
+    std::uint64_t max() const { return largest.get(); }
+    std::uint64_t mean() const { return sampled.get() == 0 ? 0 : sum.get() / sampled.get(); }
+
+    std::uint64_t percentile(double p) const
+    { // Value at or below which p percent of the recordings fall, to the histogram's precision.
+
+        std::uint64_t recorded = 0;
+        for (const Counter &bucket : buckets)
+            recorded += bucket.get();
+        if (recorded == 0)
+            return 0;
+        std::uint64_t rank = std::max<std::uint64_t>(1, static_cast<std::uint64_t>(p / 100.0 * recorded + 0.5));
+        std::uint64_t seen = 0;
+        for (int i = 0; i < kBuckets; ++i)
+        {
+            seen += buckets[i].get();
+            if (seen >= rank)
+                return std::min(highestIn(i), max());
+        }
+        return max();
+    }
+};
+
+// Counts one call, and when it is sampled records its duration on leaving scope.
+class ScopedLatency
+{
+private:
+    LatencyHistogram *histogram = nullptr;
+    std::chrono::steady_clock::time_point start;
+
+public:
+    explicit ScopedLatency(LatencyHistogram &target)
+    {
+        if (kStatsEnabled && target.sampleNext())
+        {
+            histogram = &target;
+            start = std::chrono::steady_clock::now();
+        }
+    }
+
+    ScopedLatency(const ScopedLatency &) = delete;
+    ScopedLatency &operator=(const ScopedLatency &) = delete;
+
+    ~ScopedLatency()
+    {
+        if (histogram)
+            histogram->record(static_cast<std::uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count()));
+    }
+};
+
+#endif
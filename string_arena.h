@@ -0,0 +1,99 @@
+#ifndef STRING_ARENA_H
+#define STRING_ARENA_H
+
+#include <cstddef>
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+// Append-only storage for strings. Text is copied into large chunks and the
+// returned views stay valid until the arena is destroyed; nothing is freed
+// individually, so a deleted book's title lingers until then.
+class StringArena
+{
+private:
+    static constexpr std::size_t kChunkSize = 64 * 1024;
+
+    std::vector<std::unique_ptr<char[]>> chunks;
+    char *cursor = nullptr;
+    std::size_t left = 0;
+    std::size_t bytes = 0;
+
+public:
+    StringArena() = default;
+    StringArena(const StringArena &) = delete;
+    StringArena &operator=(const StringArena &) = delete;
+
+    std::string_view store(std::string_view text)
+    {
+        if (text.empty())
+            return std::string_view("", 0);
+        if (text.size() > left)
+        {
+            if (text.size() > kChunkSize / 4)
+            { // Oversized strings get a chunk of their own so the current one is not wasted.
+                chunks.emplace_back(new char[text.size()]);
+                std::memcpy(chunks.back().get(), text.data(), text.size());
+                bytes += text.size();
+                return std::string_view(chunks.back().get(), text.size());
+            }
+            chunks.emplace_back(new char[kChunkSize]);
+            cursor = chunks.back().get();
+            left = kChunkSize;
+        }
+        std::memcpy(cursor, text.data(), text.size());
+        std::string_view stored(cursor, text.size());
+        cursor += text.size();
+        left -= text.size();
+        bytes += text.size();
+        return stored;
+    }
+
+    void adopt(StringArena &other)
+    { // Takes over other's chunks, so views into them now live as long as this arena.
+
+        chunks.insert(chunks.begin(), std::make_move_iterator(other.chunks.begin()), std::make_move_iterator(other.chunks.end()));
+        bytes += other.bytes;
+        other.chunks.clear();
+        other.cursor = nullptr;
+        other.left = 0;
+        other.bytes = 0;
+    }
+
+    std::size_t size() const { return bytes; }
+};
+
+// Deduplicates strings: every distinct text is stored once in an arena and
+// equal strings come back as the same view.
+class StringInterner
+{
+private:
+    StringArena arena;
+    std::unordered_set<std::string_view> strings;
+
+public:
+    std::string_view intern(std::string_view text)
+    {
+        auto found = strings.find(text);
+        if (found != strings.end())
+            return *found;
+        std::string_view stored = arena.store(text);
+        strings.insert(stored);
+        return stored;
+    }
+
+    void adopt(StringInterner &other)
+    { // Takes over other's strings; views other handed out stay valid.
+
+        arena.adopt(other.arena);
+        strings.merge(other.strings); // Texts both hold stay with this one's copy.
+        other.strings.clear();
+    }
+
+    std::size_t size() const { return strings.size(); }
+};
+
+#endif
@@ -0,0 +1,82 @@
+#!/bin/bash
+# Replays one input serially and with `t1 --shards` at several shard counts
+# and checks that the outputs match. The input mixes every command, including
+# a SaveSnapshot, a LoadSnapshot that rolls the library back to it, and
+# snapshot paths that cannot be written or read. Each snapshot the sharded
+# runs save is also loaded by a serial run, which must see the serial image.
+#
+# Color flip tallies are per shard, so ColorFlipCount lines are not compared.
+# The input ends with a Stats, which prints one block per shard; the output is
+# compared up to it, and the number of blocks is checked.
+#
+# Usage: tests/shard_compare.sh [t1 binary]
+set -u
+t1=$(realpath "${1:-./t1}")
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+cd "$work" || exit 1
+
+awk -v work="$work" 'BEGIN {
+    srand(29)
+    books = 5000; ops = 40000
+    for (id = 1; id <= books; ++id)
+        printf "InsertBook(%d, \"Book %d\", \"Author %d\", \"Yes\")\n", id * 2, id * 2, id % 37
+    for (i = 0; i < ops; ++i)
+    {
+        if (i == ops / 2)
+            printf "SaveSnapshot(%s/mid.snap)\nSaveSnapshot(%s/missing/x.snap)\n", work, work
+        if (i == 3 * ops / 4)
+            printf "LoadSnapshot(%s/mid.snap)\nLoadSnapshot(%s/missing/x.snap)\n", work, work
+        id = 2 * int(rand() * books * 1.2); patron = 1 + int(rand() * 200); pick = rand()
+        if (pick < 0.08)      printf "InsertBook(%d, \"New %d\", \"Author %d\", \"Yes\")\n", id + 1, id + 1, id % 37
+        else if (pick < 0.35) printf "BorrowBook(%d, %d, %d)\n", patron, id, 1 + int(rand() * 20)
+        else if (pick < 0.50) printf "ReturnBook(%d, %d)\n", patron, id
+        else if (pick < 0.54) printf "DeleteBook(%d)\n", id
+        else if (pick < 0.55) printf "DeleteRange(%d, %d)\n", id, id + int(rand() * 40)
+        else if (pick < 0.59) printf "CancelReservation(%d, %d)\n", patron, id
+        else if (pick < 0.63) printf "UpdatePriority(%d, %d, %d)\n", patron, id, 1 + int(rand() * 20)
+        else if (pick < 0.64) printf "ReturnAll(%d)\n", patron
+        else if (pick < 0.68) printf "PrintBooks(%d, %d)\n", id, id + int(rand() * 30)
+        else if (pick < 0.72) printf "FindClosestBook(%d)\n", id + 1
+        else if (pick < 0.75) printf "CountBooks(%d, %d)\n", id, id + int(rand() * 3000)
+        else if (pick < 0.78) printf "RankOf(%d)\n", id
+        else if (pick < 0.80) printf "SelectBook(%d)\n", 1 + int(rand() * books * 1.1)
+        else if (pick < 0.82) printf "PrintPatron(%d)\n", patron
+        else if (pick < 0.83) printf "FindByAuthor(\"Author %d\")\n", id % 40
+        else if (pick < 0.84) printf "FindByTitlePrefix(\"New %d\")\n", int(rand() * 100)
+        else if (pick < 0.85) print "ColorFlipCount()"
+        else                  printf "PrintBook(%d)\n", id
+    }
+    print "PrintBooks(0, 2000000000)"
+    print "Stats()"
+    print "Quit()"
+}' > input.txt
+printf 'LoadSnapshot(%s/mid.snap)\nPrintBooks(0, 2000000000)\nQuit()\n' "$work" > load.txt
+
+until_stats() { grep -v '^Color Flip Count: ' "$1" | awk '/^(Stats|Shard 0):$/ { exit } { print }'; }
+
+"$t1" input.txt > /dev/null || { echo "FAIL: t1 did not run"; exit 1; }
+until_stats input.txt_output_file.txt > expected.txt
+"$t1" load.txt > /dev/null && cp load.txt_output_file.txt expected_load.txt
+
+counts=(1 2 4 7)
+failures=0
+for shards in "${counts[@]}"; do
+    rm -f mid.snap
+    problem=
+    if ! "$t1" --shards "$shards" input.txt > /dev/null; then
+        problem="t1 failed"
+    elif ! until_stats input.txt_output_file.txt | cmp -s - expected.txt; then
+        problem="output differs from the serial run"
+    elif [ "$(grep -c '^Stats:$' input.txt_output_file.txt)" != "$shards" ]; then
+        problem="not one Stats block per shard"
+    elif ! "$t1" load.txt > /dev/null || ! cmp -s load.txt_output_file.txt expected_load.txt; then
+        problem="the saved snapshot loads differently"
+    fi
+    if [ -n "$problem" ]; then
+        echo "$shards shard(s): $problem"
+        failures=$((failures + 1))
+    fi
+done
+echo "$((${#counts[@]} - failures))/${#counts[@]} shard counts matched the serial run"
+[ "$failures" = 0 ]
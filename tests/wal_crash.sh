@@ -0,0 +1,92 @@
+#!/bin/bash
+# Kills `t1 --wal` with SIGKILL at random points, recovers from the log (and
+# the snapshot, once one was saved) and checks that the recovered run ends in
+# the same state as an uninterrupted one. Half of the trials also tear the
+# log's tail at a random byte, as a crash in the middle of a write would.
+#
+# The state is compared through the commands at the end of the input: a
+# PrintBooks over every ID and a ColorFlipCount. Output from before a crash
+# is not compared, since it is lost or repeated by design.
+#
+# The input saves a snapshot, loads it back later and then saves over the
+# same path. Replaying the whole log without --restore must then fail,
+# since the path no longer holds the image the logged load read.
+#
+# Usage: tests/wal_crash.sh [trials] [t1 binary]
+set -u
+trials=${1:-20}
+t1=$(realpath "${2:-./t1}")
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+cd "$work" || exit 1
+
+# A catalog that is bulk-loaded, then a mix of every logged mutation. A
+# snapshot is saved a third of the way through, loaded back halfway and
+# saved over two thirds of the way through.
+awk -v snapshot="$work/state.snap" 'BEGIN {
+    srand(17)
+    books = 20000; ops = 120000
+    for (id = 1; id <= books; ++id)
+        printf "InsertBook(%d, \"Book %d\", \"Author %d\", \"Yes\")\n", id * 2, id * 2, id % 97
+    for (i = 0; i < ops; ++i)
+    {
+        if (i == ops / 3 || i == 2 * ops / 3)
+            printf "SaveSnapshot(%s)\n", snapshot
+        if (i == ops / 2)
+            printf "LoadSnapshot(%s)\n", snapshot
+        id = 2 * int(rand() * books * 1.2); patron = 1 + int(rand() * 300); pick = rand()
+        if (pick < 0.10)      printf "InsertBook(%d, \"New %d\", \"Author %d\", \"Yes\")\n", id + 1, id + 1, id % 97
+        else if (pick < 0.40) printf "BorrowBook(%d, %d, %d)\n", patron, id, 1 + int(rand() * 20)
+        else if (pick < 0.60) printf "ReturnBook(%d, %d)\n", patron, id
+        else if (pick < 0.66) printf "DeleteBook(%d)\n", id
+        else if (pick < 0.68) printf "DeleteRange(%d, %d)\n", id, id + int(rand() * 40)
+        else if (pick < 0.74) printf "CancelReservation(%d, %d)\n", patron, id
+        else if (pick < 0.80) printf "UpdatePriority(%d, %d, %d)\n", patron, id, 1 + int(rand() * 20)
+        else if (pick < 0.82) printf "ReturnAll(%d)\n", patron
+        else                  printf "PrintBook(%d)\n", id
+    }
+}' > body.txt
+{ cat body.txt; echo 'PrintBooks(0, 2000000000)'; echo 'ColorFlipCount()'; echo 'Quit()'; } > input.txt
+{ cat body.txt; echo 'Quit()'; } > head.txt
+
+# The final state as an uninterrupted run prints it: everything after the body's output.
+"$t1" head.txt > /dev/null && "$t1" input.txt > /dev/null || { echo "FAIL: t1 did not run"; exit 1; }
+tail -n +$(( $(wc -l < head.txt_output_file.txt) - 1 )) input.txt_output_file.txt > expected.txt
+lines=$(wc -l < expected.txt)
+start=$(date +%s%N)
+"$t1" --wal "$work/timing.log" input.txt > /dev/null
+runMs=$(( ($(date +%s%N) - start) / 1000000 ))
+
+# The snapshot path now holds the last image, not the one the logged load read.
+stale=0
+if "$t1" --wal "$work/timing.log" input.txt > /dev/null 2>&1; then
+    echo "replaying a load of a snapshot that was saved over did not fail"
+    stale=1
+fi
+
+failures=0
+
+for trial in $(seq 1 "$trials"); do
+    rm -f state.log state.snap input.txt_output_file.txt
+    "$t1" --wal "$work/state.log" input.txt > /dev/null &
+    pid=$!
+    sleep "$(awk -v ms=$(( RANDOM % (runMs + 1) )) 'BEGIN { printf "%.3f", ms / 1000 }')"
+    kill -9 $pid 2> /dev/null
+    wait $pid 2> /dev/null
+    size=$(stat -c %s state.log 2> /dev/null || echo 0)
+    if [ $((RANDOM % 2)) = 1 ] && [ "$size" -gt 100 ]; then
+        size=$(( size - RANDOM % 100 ))
+        truncate -s "$size" state.log
+    fi
+    restore=()
+    [ -f state.snap ] && restore=(--restore "$work/state.snap")
+    if ! "$t1" "${restore[@]}" --wal "$work/state.log" input.txt > /dev/null; then
+        echo "trial $trial: recovery failed (log $size bytes)"
+        failures=$((failures + 1))
+    elif ! tail -n "$lines" input.txt_output_file.txt | cmp -s - expected.txt; then
+        echo "trial $trial: recovered state differs (log $size bytes)"
+        failures=$((failures + 1))
+    fi
+done
+echo "$((trials - failures))/$trials crash trials recovered the uninterrupted state"
+[ "$failures" = 0 ] && [ "$stale" = 0 ]
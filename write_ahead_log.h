@@ -0,0 +1,434 @@
+#ifndef WRITE_AHEAD_LOG_H
+#define WRITE_AHEAD_LOG_H
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <iterator>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include "snapshot.h"
+
+// Append-only binary log of library mutations. Each mutation is appended
+// before it is applied; records are buffered and made durable together
+// (group commit) once `batchRecords` are pending or the oldest pending record
+// is `interval` old, whichever comes first. A flusher thread watches the
+// interval, so a record is never left unsynced for longer than that, even
+// when no further mutation arrives. commit() forces the pending batch out.
+//
+// Record layout: a 32-byte header followed by the payload.
+//   uint32 payload size, uint32 CRC-32 of everything after it,
+//   uint64 sequence, uint64 input position, uint8 op, 7 bytes padding.
+// Payload: int32 and uint64 values and (uint32 length, bytes) strings, per op.
+//
+// Reading stops at the first short or corrupt record, which is where a
+// crash cut the log off; reopening for append truncates the file there.
+class WriteAheadLog
+{
+public:
+    enum class Op : std::uint8_t
+    {
+        InsertBook = 1,    // bookID, title, author
+        BulkLoad,          // count, then bookID, title, author, available per book
+        BorrowBook,        // patronID, bookID, priority
+        ReturnBook,        // patronID, bookID
+        DeleteBook,        // bookID
+        CancelReservation, // patronID, bookID
+        UpdatePriority,    // patronID, bookID, priority
+        ReturnAll,         // patronID
+        LoadSnapshot,      // path, then the image's walSequence, size (uint64 each) and checksum (see SnapshotIdentity)
+        DeleteRange        // bookID1, bookID2
+    };
+
+    struct BookEntry
+    {
+        int bookID;
+        std::string_view bookName;
+        std::string_view authorName;
+        bool availability;
+    };
+
+    // A decoded record. Strings point into the log's mapping and are only
+    // valid during the read callback.
+    struct Record
+    {
+        Op op;
+        std::uint64_t sequence;
+        std::uint64_t position;
+        int values[3];
+        std::string_view strings[2];
+        std::vector<BookEntry> books;
+        SnapshotIdentity image; // LoadSnapshot only.
+    };
+
+private:
+    static constexpr std::size_t kHeaderSize = 32;
+
+    int fd = -1;
+    std::string buffer;
+    std::size_t pending = 0;
+    std::size_t batchRecords;
+    std::chrono::steady_clock::duration interval;
+    std::chrono::steady_clock::time_point firstPending; // When the oldest pending record was appended.
+    std::uint64_t nextSequence = 1;
+    std::uint64_t position = 0;
+    std::atomic<std::uint64_t> commits{0}; // These two are written by the flusher too.
+    std::atomic<bool> failed{false};
+    std::mutex appendMutex; // Appends come from BorrowBook/ReturnBook under the library's shared lock.
+    std::condition_variable flushWake;
+    std::thread flusher;
+    bool closing = false;
+
+    template <typename T>
+    static void put(std::string &out, T value) { out.append(reinterpret_cast<const char *>(&value), sizeof(value)); }
+
+    static void putString(std::string &out, std::string_view text)
+    {
+        put(out, static_cast<std::uint32_t>(text.size()));
+        out.append(text.data(), text.size());
+    }
+
+    // Bounds-checked payload reader.
+    struct Reader
+    {
+        const char *at;
+        const char *end;
+        bool ok = true;
+
+        std::int32_t value()
+        {
+            std::int32_t v = 0;
+            if (end - at < 4)
+                ok = false;
+            else
+            {
+                std::memcpy(&v, at, 4);
+                at += 4;
+            }
+            return v;
+        }
+
+        std::uint64_t wide()
+        {
+            std::uint64_t v = 0;
+            if (end - at < 8)
+                ok = false;
+            else
+            {
+                std::memcpy(&v, at, 8);
+                at += 8;
+            }
+            return v;
+        }
+
+        std::string_view string()
+        {
+            std::uint32_t length = static_cast<std::uint32_t>(value());
+            if (!ok || static_cast<std::size_t>(end - at) < length)
+            {
+                ok = false;
+                return {};
+            }
+            std::string_view text(at, length);
+            at += length;
+            return text;
+        }
+    };
+
+    static bool decode(Op op, Reader reader, Record &record)
+    {
+        switch (op)
+        {
+        case Op::InsertBook:
+            record.values[0] = reader.value();
+            record.strings[0] = reader.string();
+            record.strings[1] = reader.string();
+            break;
+        case Op::BulkLoad:
+        {
+            std::int32_t count = reader.value();
+            if (count < 0 || count > (reader.end - reader.at) / 16)
+                return false;
+            record.books.clear();
+            record.books.reserve(count);
+            for (std::int32_t i = 0; i < count && reader.ok; ++i)
+            {
+                BookEntry entry;
+                entry.bookID = reader.value();
+                entry.bookName = reader.string();
+                entry.authorName = reader.string();
+                entry.availability = reader.value() != 0;
+                record.books.push_back(entry);
+            }
+            break;
+        }
+        case Op::BorrowBook:
+        case Op::UpdatePriority:
+            for (int i = 0; i < 3; ++i)
+                record.values[i] = reader.value();
+            break;
+        case Op::ReturnBook:
+        case Op::CancelReservation:
+        case Op::DeleteRange:
+            for (int i = 0; i < 2; ++i)
+                record.values[i] = reader.value();
+            break;
+        case Op::DeleteBook:
+        case Op::ReturnAll:
+            record.values[0] = reader.value();
+            break;
+        case Op::LoadSnapshot:
+            record.strings[0] = reader.string();
+            record.image.walSequence = reader.wide();
+            record.image.size = reader.wide();
+            record.image.checksum = static_cast<std::uint32_t>(reader.value());
+            break;
+        default:
+            return false;
+        }
+        return reader.ok && reader.at == reader.end;
+    }
+
+    void writeAll(const char *data, std::size_t size)
+    {
+        while (size > 0 && !failed)
+        {
+            ssize_t written = ::write(fd, data, size);
+            if (written < 0)
+            {
+                if (errno != EINTR)
+                    failed = true;
+                continue;
+            }
+            data += written;
+            size -= static_cast<std::size_t>(written);
+        }
+    }
+
+    void commitLocked()
+    {
+        if (fd < 0 || buffer.empty())
+            return;
+        writeAll(buffer.data(), buffer.size());
+        if (!failed && ::fdatasync(fd) != 0)
+            failed = true;
+        buffer.clear();
+        pending = 0;
+        ++commits;
+    }
+
+    void flushOnTime()
+    { // The flusher thread: commits a batch that reached `interval` without filling up.
+
+        std::unique_lock<std::mutex> lock(appendMutex);
+        while (!closing)
+        {
+            if (pending == 0)
+                flushWake.wait(lock);
+            else if (std::chrono::steady_clock::now() - firstPending >= interval)
+                commitLocked();
+            else
+                flushWake.wait_until(lock, firstPending + interval);
+        }
+    }
+
+    template <typename Encode>
+    std::uint64_t append(Op op, Encode encode)
+    {
+        std::lock_guard<std::mutex> guard(appendMutex);
+        if (fd < 0)
+            return 0;
+        std::size_t start = buffer.size();
+        buffer.resize(start + kHeaderSize);
+        encode(buffer);
+        std::uint64_t sequence = nextSequence++;
+        char *header = &buffer[start];
+        std::uint32_t size = static_cast<std::uint32_t>(buffer.size() - start - kHeaderSize);
+        std::memset(header, 0, kHeaderSize);
+        std::memcpy(header, &size, 4);
+        std::memcpy(header + 8, &sequence, 8);
+        std::memcpy(header + 16, &position, 8);
+        header[24] = static_cast<char>(op);
+        std::uint32_t crc = crc32(header + 8, buffer.size() - start - 8);
+        std::memcpy(header + 4, &crc, 4);
+        if (pending++ == 0)
+        {
+            firstPending = std::chrono::steady_clock::now();
+            flushWake.notify_one();
+        }
+        if (pending >= batchRecords)
+            commitLocked();
+        return sequence;
+    }
+
+public:
+    static std::uint32_t crc32(const char *data, std::size_t size)
+    { // CRC-32 (IEEE), as the records carry it; LoadSnapshot uses it to identify an image.
+
+        static const auto table = []
+        {
+            std::vector<std::uint32_t> entries(256);
+            for (std::uint32_t i = 0; i < 256; ++i)
+            {
+                std::uint32_t c = i;
+                for (int bit = 0; bit < 8; ++bit)
+                    c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                entries[i] = c;
+            }
+            return entries;
+        }();
+        std::uint32_t crc = 0xFFFFFFFFu;
+        for (std::size_t i = 0; i < size; ++i)
+            crc = table[(crc ^ static_cast<unsigned char>(data[i])) & 0xFF] ^ (crc >> 8);
+        return crc ^ 0xFFFFFFFFu;
+    }
+
+    explicit WriteAheadLog(std::size_t batchRecords = 64, std::chrono::milliseconds interval = std::chrono::milliseconds(10))
+        : batchRecords(batchRecords == 0 ? 1 : batchRecords), interval(interval)
+    {
+    }
+
+    WriteAheadLog(const WriteAheadLog &) = delete;
+    WriteAheadLog &operator=(const WriteAheadLog &) = delete;
+
+    ~WriteAheadLog() { close(); }
+
+    template <typename Visit>
+    static std::size_t read(const std::string &path, Visit visit)
+    { // Calls visit(record) for every intact record in order. Returns the length of that intact prefix.
+
+        MappedFile file(path);
+        if (!file.isOpen())
+            return 0;
+        const char *data = file.data();
+        std::size_t offset = 0;
+        Record record;
+        while (file.size() - offset >= kHeaderSize)
+        {
+            const char *header = data + offset;
+            std::uint32_t size, crc;
+            std::memcpy(&size, header, 4);
+            std::memcpy(&crc, header + 4, 4);
+            if (size > file.size() - offset - kHeaderSize || crc32(header + 8, kHeaderSize - 8 + size) != crc)
+                break;
+            std::memcpy(&record.sequence, header + 8, 8);
+            std::memcpy(&record.position, header + 16, 8);
+            record.op = static_cast<Op>(header[24]);
+            if (!decode(record.op, Reader{header + kHeaderSize, header + kHeaderSize + size}, record))
+                break;
+            visit(static_cast<const Record &>(record));
+            offset += kHeaderSize + size;
+        }
+        return offset;
+    }
+
+    bool open(const std::string &path, std::size_t validLength, std::uint64_t lastSequence)
+    { // Opens path for appending after its first validLength bytes (anything after them is a torn
+      // tail and is cut off). New records are numbered from lastSequence + 1.
+
+        close();
+        fd = ::open(path.c_str(), O_WRONLY | O_CREAT, 0644);
+        if (fd < 0)
+            return false;
+        if (::ftruncate(fd, static_cast<off_t>(validLength)) != 0 || ::lseek(fd, 0, SEEK_END) < 0 || ::fsync(fd) != 0)
+        {
+            ::close(fd);
+            fd = -1;
+            return false;
+        }
+        nextSequence = lastSequence + 1;
+        failed = false;
+        closing = false;
+        flusher = std::thread([this]
+                              { flushOnTime(); });
+        return true;
+    }
+
+    void close()
+    {
+        if (flusher.joinable())
+        {
+            {
+                std::lock_guard<std::mutex> guard(appendMutex);
+                closing = true;
+            }
+            flushWake.notify_one();
+            flusher.join();
+        }
+        std::lock_guard<std::mutex> guard(appendMutex);
+        commitLocked();
+        if (fd >= 0)
+            ::close(fd);
+        fd = -1;
+    }
+
+    void commit()
+    {
+        std::lock_guard<std::mutex> guard(appendMutex);
+        commitLocked();
+    }
+
+    bool isOpen() const { return fd >= 0; }
+    bool healthy() const { return !failed; }
+    std::uint64_t lastSequence() const { return nextSequence - 1; }
+    std::uint64_t commitCount() const { return commits; }
+
+    // Position of the input command being applied, stored with every record so recovery
+    // knows how much of the input is already reflected in the log.
+    void setPosition(std::uint64_t inputPosition) { position = inputPosition; }
+
+    void insertBook(int bookID, std::string_view bookName, std::string_view authorName)
+    {
+        append(Op::InsertBook, [&](std::string &out)
+               {
+            put<std::int32_t>(out, bookID);
+            putString(out, bookName);
+            putString(out, authorName); });
+    }
+
+    template <typename Iterator>
+    void bulkLoad(Iterator first, Iterator last)
+    {
+        append(Op::BulkLoad, [&](std::string &out)
+               {
+            put<std::int32_t>(out, static_cast<std::int32_t>(std::distance(first, last)));
+            for (; first != last; ++first)
+            {
+                put<std::int32_t>(out, first->bookID);
+                putString(out, first->bookName);
+                putString(out, first->authorName);
+                put<std::int32_t>(out, first->availability ? 1 : 0);
+            } });
+    }
+
+    void values(Op op, std::initializer_list<int> values)
+    { // Records an op whose payload is just int32 values.
+
+        append(op, [&](std::string &out)
+               {
+            for (int value : values)
+                put<std::int32_t>(out, value); });
+    }
+
+    void loadSnapshot(std::string_view path, const SnapshotIdentity &image)
+    {
+        append(Op::LoadSnapshot, [&](std::string &out)
+               {
+            putString(out, path);
+            put<std::uint64_t>(out, image.walSequence);
+            put<std::uint64_t>(out, image.size);
+            put<std::uint32_t>(out, image.checksum); });
+    }
+};
+
+#endif